@@ -0,0 +1,236 @@
+
+#include <functional>
+#include <iomanip>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "output_polygon.h"
+#include "point_field.h"
+#include "pov_writer.h"
+#include "primitives.h"
+#include "random_generator.h"
+#include "stats.h"
+#include "synthetic_osm.h"
+
+#define MIN_BENCHMARK_SECONDS 0.5
+#define POINT_QUERIES 100000
+
+bool g_quiet_mode = true;
+
+//all allocations are counted, benchmarks run only in main thread
+static size_t g_allocations = 0;
+static size_t g_allocated_bytes = 0;
+
+void *operator new(size_t size) {
+	g_allocations++;
+	g_allocated_bytes += size;
+	void *pointer = malloc(size);
+	if (pointer == NULL) throw bad_alloc();
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+	free(pointer);
+}
+
+struct BenchmarkRun {
+	size_t ops;
+	uint64_t output_bytes;		//0 when benchmark doesn't write anything
+};
+
+static void PrintHelpAndExit() {
+	cout << "Using:\tosm2pov-bench [--scale N] [--write-osm FILE]" << endl;
+	cout << "\t--scale N - size of synthetic data, every next scale has roughly twice more objects (default is 1)" << endl;
+	cout << "\t--write-osm FILE - only write synthetic OSM data to file (e.g. for profiling of osm2pov)" << endl << endl;
+	cout << "Benchmarks of hot paths of osm2pov on synthetic data. Every benchmark runs at least " << MIN_BENCHMARK_SECONDS << " s." << endl;
+	exit(1);
+}
+
+//body is run again until it takes at least MIN_BENCHMARK_SECONDS; it returns count of operations it made
+static void RunBenchmark(const char *name, const char *unit, const function<BenchmarkRun()> &body) {
+	const size_t allocations = g_allocations, allocated_bytes = g_allocated_bytes;
+	size_t runs = 0, ops = 0;
+	uint64_t output_bytes = 0;
+	StopWatch stop_watch;
+	do {
+		const BenchmarkRun run = body();
+		ops += run.ops;
+		output_bytes += run.output_bytes;
+		runs++;
+	} while (stop_watch.getSeconds() < MIN_BENCHMARK_SECONDS);
+	const double seconds = stop_watch.getSeconds();
+	const double ops_divider = max<size_t>(ops, 1);
+
+	cout << left << setw(40) << name << right << setw(6) << runs << setw(10) << ops << " " << left << setw(11) << unit << right
+	 << setw(13) << fixed << setprecision(0) << ops/seconds << setw(11) << setprecision(2) << (g_allocations-allocations)/ops_divider
+	 << setw(11) << setprecision(1) << (g_allocated_bytes-allocated_bytes)/ops_divider;
+	if (output_bytes > 0) cout << setw(9) << setprecision(1) << output_bytes/seconds/1e6;
+	cout << endl;
+}
+
+static uint64_t GetFileSize(const char *filename) {
+	struct stat file_stat;
+	return (stat(filename, &file_stat) == 0 ? file_stat.st_size : 0);
+}
+
+//multipolygons of relations with the tag (assembled)
+static void AssembleRelations(const Primitives &primitives, const char *key, const char *value, vector<MultiPolygon*> *output) {
+	PrimitivesView view(primitives);
+	list<MultiPolygon*> multipolygons;
+	view.getMultiPolygonsWithAttribute(&multipolygons, key, value);
+	output->assign(multipolygons.begin(), multipolygons.end());
+}
+
+int main(int argc, const char **argv) {
+	size_t scale = 1;
+	const char *osm_filename = NULL;
+	for (int argc_i = 1; argc_i < argc; argc_i++) {
+		if (strcmp(argv[argc_i], "--scale") == 0 && argc_i+1 < argc) scale = atoi(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--write-osm") == 0 && argc_i+1 < argc) osm_filename = argv[++argc_i];
+		else PrintHelpAndExit();
+	}
+	if (scale < 1) PrintHelpAndExit();
+
+	const SyntheticOsm synthetic_osm((SyntheticOsmOptions(scale)));
+	if (osm_filename != NULL) return (synthetic_osm.write(osm_filename) ? 0 : 1);
+
+	char directory[] = "/tmp/osm2pov-bench-XXXXXX";
+	if (mkdtemp(directory) == NULL) {
+		cerr << "Cannot create temporary directory!" << endl;
+		return 1;
+	}
+	const string input_filename = string(directory) + "/synthetic.osm";
+	const string output_filename = string(directory) + "/output.pov";
+	if (!synthetic_osm.write(input_filename.c_str())) return 1;
+
+	Primitives primitives;
+	if (!primitives.loadFromXml(input_filename.c_str())) return 1;
+	const Rect rect = primitives.getInterestRect();
+
+	vector<MultiPolygon*> forests, rings, buildings;
+	AssembleRelations(primitives, "landuse", "forest", &forests);
+	AssembleRelations(primitives, "landuse", "meadow", &rings);
+	AssembleRelations(primitives, "building", "yes", &buildings);
+
+	vector<vector<Triangle> > forest_triangles(forests.size());
+	for (size_t i = 0; i < forests.size(); i++) forests[i]->convertToTriangles(&forest_triangles[i]);
+
+	PointField point_field;		//streets, as they are added by Osm2PovConverter
+	{
+		PrimitivesView view(primitives);
+		list<const Way*> streets;
+		view.getWaysWithAttribute(&streets, "highway", NULL);
+		for (list<const Way*>::const_iterator it = streets.begin(); it != streets.end(); it++) {
+			const vector<const Node*> &nodes = (*it)->getNodes();
+			for (size_t i = 1; i < nodes.size(); i++) {
+				point_field.addPointsInDistance(nodes[i-1]->getLon(), nodes[i-1]->getLat(), nodes[i]->getLon(), nodes[i]->getLat(), metres2unit(8));
+			}
+		}
+	}
+	vector<XY> queries;
+	{
+		RandomGenerator random(1);
+		for (size_t i = 0; i < POINT_QUERIES; i++) {
+			queries.push_back(XY(rect.minlon + (rect.maxlon-rect.minlon) * random.nextBelow(1000000)/1e6,
+			 rect.minlat + (rect.maxlat-rect.minlat) * random.nextBelow(1000000)/1e6));
+		}
+	}
+
+	cout << "Synthetic data: " << synthetic_osm.getPrimitivesCount() << " primitives, " << GetFileSize(input_filename.c_str()) << " bytes" << endl;
+	cout << left << setw(40) << "Benchmark" << right << setw(6) << "Runs" << setw(10) << "Ops" << " " << left << setw(11) << "" << right
+	 << setw(13) << "Ops/s" << setw(11) << "Allocs/op" << setw(11) << "Bytes/op" << setw(9) << "MB/s" << endl;
+
+	RunBenchmark("Primitives::loadFromXml", "primitives", [&]() {
+		Primitives loaded;
+		loaded.loadFromXml(input_filename.c_str());
+		const BenchmarkRun run = { synthetic_osm.getPrimitivesCount(), 0 };
+		return run;
+	});
+
+	RunBenchmark("MultiPolygon::setDone (AddPolygonToList)", "ways", [&]() {
+		BenchmarkRun run = { 0, 0 };
+		for (vector<MultiPolygon*>::const_iterator it = rings.begin(); it != rings.end(); it++) {
+			const Relation *relation = primitives.getRelation((*it)->getRelationId());
+			MultiPolygon multipolygon(relation, rect);
+			const vector<const PrimitiveRole*> &members = relation->getRelationMembers();
+			for (vector<const PrimitiveRole*>::const_iterator it2 = members.begin(); it2 != members.end(); it2++) {
+				multipolygon.addOuterPart(dynamic_cast<const Way*>(&(*it2)->primitive));
+			}
+			multipolygon.setDone();
+			run.ops += members.size();
+		}
+		return run;
+	});
+
+	RunBenchmark("MultiPolygon::convertToTriangles forests", "polygons", [&]() {
+		BenchmarkRun run = { forests.size(), 0 };
+		for (vector<MultiPolygon*>::const_iterator it = forests.begin(); it != forests.end(); it++) {
+			vector<Triangle> triangles;
+			(*it)->convertToTriangles(&triangles);
+		}
+		return run;
+	});
+
+	RunBenchmark("MultiPolygon::convertToTriangles build.", "polygons", [&]() {
+		BenchmarkRun run = { buildings.size(), 0 };
+		for (vector<MultiPolygon*>::const_iterator it = buildings.begin(); it != buildings.end(); it++) {
+			vector<Triangle> triangles;
+			(*it)->convertToTriangles(&triangles);
+		}
+		return run;
+	});
+
+	RunBenchmark("ComputeRegularInsidePoints", "points", [&]() {
+		BenchmarkRun run = { 0, 0 };
+		for (size_t i = 0; i < forests.size(); i++) {
+			vector<PointFieldItem*> trees;
+			ComputeRegularInsidePoints(&forest_triangles[i], &trees, &point_field, forests[i]->getId(), rect, 0, 4);
+			run.ops += trees.size();
+			for (vector<PointFieldItem*>::iterator it = trees.begin(); it != trees.end(); it++) {
+				delete (*it)->xy;
+				delete *it;
+			}
+		}
+		return run;
+	});
+
+	RunBenchmark("PointField::isPointNearOther", "queries", [&]() {
+		BenchmarkRun run = { queries.size(), 0 };
+		size_t near_count = 0;
+		for (vector<XY>::const_iterator it = queries.begin(); it != queries.end(); it++) {
+			if (point_field.isPointNearOther(it->x, it->y)) near_count++;
+		}
+		if (near_count > queries.size()) cerr << "Impossible!" << endl;		//result must be used
+		return run;
+	});
+
+	RunBenchmark("PovWriter", "objects", [&]() {
+		BenchmarkRun run = { 0, 0 };
+		{
+			PovWriter writer(output_filename.c_str(), rect, true, DEFAULT_ZOOM);
+			for (size_t i = 0; i < forests.size(); i++) {
+				writer.writePolygon(forests[i]->getId(), forest_triangles[i], 0, "forest");
+				run.ops += forest_triangles[i].size();
+			}
+			for (vector<MultiPolygon*>::const_iterator it = buildings.begin(); it != buildings.end(); it++) {
+				const XY &xy = (*it)->getOuterParts().front().front();
+				writer.writeBox(writer.convertLonToCoord(xy.x), writer.convertLatToCoord(xy.y), 0.2, 0.2, 0.2, 30, "building");
+				writer.writeSprite(xy.x, xy.y, "tree", 1, 0.3);
+				run.ops += 2;
+			}
+		}
+		run.output_bytes = GetFileSize(output_filename.c_str());
+		return run;
+	});
+
+	for (vector<MultiPolygon*>::iterator it = forests.begin(); it != forests.end(); it++) delete *it;
+	for (vector<MultiPolygon*>::iterator it = rings.begin(); it != rings.end(); it++) delete *it;
+	for (vector<MultiPolygon*>::iterator it = buildings.begin(); it != buildings.end(); it++) delete *it;
+	unlink(input_filename.c_str());
+	unlink(output_filename.c_str());
+	unlink((output_filename + ".hash").c_str());
+	rmdir(directory);
+	return 0;
+}
@@ -0,0 +1,185 @@
+
+#include <cmath>
+
+#include "global.h"
+#include "random_generator.h"
+#include "synthetic_osm.h"
+
+#define BASE_LAT 50.0
+#define BASE_LON 14.0
+#define BLOCK_LAT 0.0013		//block is roughly square (100x100 m)
+#define BLOCK_LON 0.002
+#define FOREST_RADIUS 0.01
+#define RING_RADIUS 0.008
+
+//scale 1 is small data for quick run, every next scale has roughly twice more objects
+SyntheticOsmOptions::SyntheticOsmOptions(size_t scale) {
+	this->street_grid_size = 8 * static_cast<size_t>(ceil(sqrt(static_cast<double>(scale))));
+	this->buildings_per_block_side = 4;
+	this->forests = 2 * scale;
+	this->forest_outer_nodes = 400;
+	this->forest_holes = 100;
+	this->rings = 2 * scale;
+	this->ring_ways = 200;
+	this->ring_way_nodes = 20;
+	this->seed = 1;
+}
+
+SyntheticOsm::SyntheticOsm(const SyntheticOsmOptions &options) {
+	RandomGenerator random(options.seed);
+	this->addStreetGrid(options, &random);
+	this->addForests(options, &random);
+	this->addRings(options, &random);
+}
+
+uint64_t SyntheticOsm::addNode(double lat, double lon) {
+	const NodeRecord node = { lat, lon };
+	this->nodes.push_back(node);
+	return this->nodes.size();
+}
+
+uint64_t SyntheticOsm::addWay(const vector<uint64_t> &node_ids, const char *key, const char *value) {
+	this->ways.push_back(WayRecord());
+	this->ways.back().node_ids = node_ids;
+	if (key != NULL) this->ways.back().tags.push_back(make_pair(key, value));
+	return this->ways.size();
+}
+
+uint64_t SyntheticOsm::addRectangle(double minlat, double minlon, double maxlat, double maxlon, const char *key, const char *value) {
+	vector<uint64_t> node_ids;
+	node_ids.push_back(this->addNode(minlat, minlon));
+	node_ids.push_back(this->addNode(minlat, maxlon));
+	node_ids.push_back(this->addNode(maxlat, maxlon));
+	node_ids.push_back(this->addNode(maxlat, minlon));
+	node_ids.push_back(node_ids.front());
+	return this->addWay(node_ids, key, value);
+}
+
+static double GetJitter(RandomGenerator *random, double max) {
+	return (random->nextBelow(2001) / 1000.0 - 1) * max;
+}
+
+//streets are ways between crossings, every block is filled by buildings
+void SyntheticOsm::addStreetGrid(const SyntheticOsmOptions &options, RandomGenerator *random) {
+	const size_t size = options.street_grid_size;
+	vector<uint64_t> crossings((size+1) * (size+1));
+	for (size_t y = 0; y <= size; y++) {
+		for (size_t x = 0; x <= size; x++) crossings[y*(size+1) + x] = this->addNode(BASE_LAT + y*BLOCK_LAT, BASE_LON + x*BLOCK_LON);
+	}
+	for (size_t i = 0; i <= size; i++) {
+		vector<uint64_t> row, column;
+		for (size_t j = 0; j <= size; j++) {
+			row.push_back(crossings[i*(size+1) + j]);
+			column.push_back(crossings[j*(size+1) + i]);
+		}
+		this->addWay(row, "highway", "residential");
+		this->addWay(column, "highway", "residential");
+	}
+
+	const size_t per_side = options.buildings_per_block_side;
+	const double cell_lat = BLOCK_LAT*0.8 / per_side, cell_lon = BLOCK_LON*0.8 / per_side;
+	for (size_t y = 0; y < size; y++) {
+		for (size_t x = 0; x < size; x++) {
+			for (size_t i = 0; i < per_side*per_side; i++) {
+				const double minlat = BASE_LAT + y*BLOCK_LAT + BLOCK_LAT*0.1 + (i / per_side)*cell_lat + GetJitter(random, cell_lat*0.1);
+				const double minlon = BASE_LON + x*BLOCK_LON + BLOCK_LON*0.1 + (i % per_side)*cell_lon + GetJitter(random, cell_lon*0.1);
+				this->addRectangle(minlat + cell_lat*0.1, minlon + cell_lon*0.1, minlat + cell_lat*0.7, minlon + cell_lon*0.7, "building", "yes");
+			}
+		}
+	}
+}
+
+//forests east of the grid; outer ring is rough circle and holes are in grid inside it
+void SyntheticOsm::addForests(const SyntheticOsmOptions &options, RandomGenerator *random) {
+	const double center_lon = BASE_LON + options.street_grid_size*BLOCK_LON + FOREST_RADIUS*2;
+	const size_t holes_per_side = static_cast<size_t>(ceil(sqrt(static_cast<double>(options.forest_holes))));
+	for (size_t i = 0; i < options.forests; i++) {
+		const double center_lat = BASE_LAT + i*FOREST_RADIUS*2.5;
+		RelationRecord relation;
+
+		vector<uint64_t> outer;
+		for (size_t j = 0; j < options.forest_outer_nodes; j++) {
+			const double angle = 2*M_PI*j / options.forest_outer_nodes;
+			const double radius = FOREST_RADIUS * (1 + GetJitter(random, 0.05));
+			outer.push_back(this->addNode(center_lat + radius*sin(angle)*0.65, center_lon + radius*cos(angle)));
+		}
+		outer.push_back(outer.front());
+		relation.members.push_back(make_pair(this->addWay(outer, NULL, NULL), "outer"));
+
+		const double inner_side = FOREST_RADIUS*1.2 / holes_per_side;		//holes are in square inside the circle
+		for (size_t j = 0; j < options.forest_holes; j++) {
+			const double minlat = center_lat + (-FOREST_RADIUS*0.6 + (j / holes_per_side)*inner_side)*0.65;
+			const double minlon = center_lon - FOREST_RADIUS*0.6 + (j % holes_per_side)*inner_side;
+			const uint64_t hole = this->addRectangle(minlat + inner_side*0.2*0.65, minlon + inner_side*0.2, minlat + inner_side*0.6*0.65, minlon + inner_side*0.6, NULL, NULL);
+			relation.members.push_back(make_pair(hole, "inner"));
+		}
+
+		relation.tags.push_back(make_pair("type", "multipolygon"));
+		relation.tags.push_back(make_pair("landuse", "forest"));
+		this->relations.push_back(relation);
+	}
+}
+
+//rings east of forests, their outer ways are connected end to end but they are in random order in relation
+void SyntheticOsm::addRings(const SyntheticOsmOptions &options, RandomGenerator *random) {
+	const double center_lon = BASE_LON + options.street_grid_size*BLOCK_LON + FOREST_RADIUS*5 + RING_RADIUS;
+	const size_t points_count = options.ring_ways * options.ring_way_nodes;
+	for (size_t i = 0; i < options.rings; i++) {
+		const double center_lat = BASE_LAT + i*RING_RADIUS*2.5;
+		vector<uint64_t> points;
+		for (size_t j = 0; j < points_count; j++) {
+			const double angle = 2*M_PI*j / points_count;
+			points.push_back(this->addNode(center_lat + RING_RADIUS*sin(angle)*0.65, center_lon + RING_RADIUS*cos(angle)));
+		}
+
+		RelationRecord relation;
+		for (size_t j = 0; j < options.ring_ways; j++) {
+			vector<uint64_t> way_nodes;
+			for (size_t k = 0; k <= options.ring_way_nodes; k++) way_nodes.push_back(points[(j*options.ring_way_nodes + k) % points_count]);
+			relation.members.push_back(make_pair(this->addWay(way_nodes, NULL, NULL), "outer"));
+		}
+		for (size_t j = relation.members.size()-1; j > 0; j--) swap(relation.members[j], relation.members[random->nextBelow(j+1)]);
+
+		relation.tags.push_back(make_pair("type", "multipolygon"));
+		relation.tags.push_back(make_pair("landuse", "meadow"));
+		this->relations.push_back(relation);
+	}
+}
+
+bool SyntheticOsm::write(const char *filename) const {
+	ofstream fs(filename);
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+	fs.precision(7);
+	fs << fixed;
+
+	fs << "<?xml version='1.0' encoding='UTF-8'?>\n<osm version='0.6' generator='osm2pov-bench'>\n";
+	for (size_t i = 0; i < this->nodes.size(); i++) {
+		fs << " <node id='" << i+1 << "' lat='" << this->nodes[i].lat << "' lon='" << this->nodes[i].lon << "'/>\n";
+	}
+	for (size_t i = 0; i < this->ways.size(); i++) {
+		const WayRecord &way = this->ways[i];
+		fs << " <way id='" << i+1 << "'>\n";
+		for (vector<uint64_t>::const_iterator it = way.node_ids.begin(); it != way.node_ids.end(); it++) fs << "  <nd ref='" << *it << "'/>\n";
+		for (vector<pair<const char*,const char*> >::const_iterator it = way.tags.begin(); it != way.tags.end(); it++) {
+			fs << "  <tag k='" << it->first << "' v='" << it->second << "'/>\n";
+		}
+		fs << " </way>\n";
+	}
+	for (size_t i = 0; i < this->relations.size(); i++) {
+		const RelationRecord &relation = this->relations[i];
+		fs << " <relation id='" << i+1 << "'>\n";
+		for (vector<pair<uint64_t,const char*> >::const_iterator it = relation.members.begin(); it != relation.members.end(); it++) {
+			fs << "  <member type='way' ref='" << it->first << "' role='" << it->second << "'/>\n";
+		}
+		for (vector<pair<const char*,const char*> >::const_iterator it = relation.tags.begin(); it != relation.tags.end(); it++) {
+			fs << "  <tag k='" << it->first << "' v='" << it->second << "'/>\n";
+		}
+		fs << " </relation>\n";
+	}
+	fs << "</osm>\n";
+
+	return fs.good();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+//Sizes of generated data; the same options (and seed) give the same file
+struct SyntheticOsmOptions {
+	size_t street_grid_size;		//count of blocks in every direction, streets are around them
+	size_t buildings_per_block_side;		//block is filled by NxN buildings
+	size_t forests;
+	size_t forest_outer_nodes;		//outer ring of forest is one way
+	size_t forest_holes;			//every forest has so many holes (clearings) in grid inside it
+	size_t rings;					//multipolygons with outer ring split into many ways
+	size_t ring_ways;
+	size_t ring_way_nodes;
+	uint64_t seed;
+
+	SyntheticOsmOptions(size_t scale);
+};
+
+//Deterministic synthetic OSM data for benchmarks: street grid with dense buildings in its blocks, huge forests
+//with many holes and long rings of multipolygon relations (with ways in shuffled order) east of the grid.
+//File is sorted as common OSM files (nodes, ways, relations).
+class SyntheticOsm {
+	private:
+	struct NodeRecord {
+		double lat, lon;
+	};
+	struct WayRecord {
+		vector<uint64_t> node_ids;
+		vector<pair<const char*,const char*> > tags;
+	};
+	struct RelationRecord {
+		vector<pair<uint64_t,const char*> > members;		//id of way and role
+		vector<pair<const char*,const char*> > tags;
+	};
+
+	vector<NodeRecord> nodes;		//id is position+1
+	vector<WayRecord> ways;
+	vector<RelationRecord> relations;
+
+	uint64_t addNode(double lat, double lon);
+	uint64_t addWay(const vector<uint64_t> &node_ids, const char *key, const char *value);
+	uint64_t addRectangle(double minlat, double minlon, double maxlat, double maxlon, const char *key, const char *value);
+	void addStreetGrid(const SyntheticOsmOptions &options, class RandomGenerator *random);
+	void addForests(const SyntheticOsmOptions &options, RandomGenerator *random);
+	void addRings(const SyntheticOsmOptions &options, RandomGenerator *random);
+
+	public:
+	SyntheticOsm(const SyntheticOsmOptions &options);
+	size_t getPrimitivesCount() const { return this->nodes.size() + this->ways.size() + this->relations.size(); }
+	bool write(const char *filename) const;
+};
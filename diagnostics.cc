@@ -0,0 +1,95 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "diagnostics.h"
+#include "primitives.h"
+#include "stats.h"
+
+Diagnostics g_diagnostics;
+
+Diagnostics::Diagnostics() {
+	for (size_t i = 0; i < diagnostic_kinds_count; i++) {
+		this->kinds[i].count = 0;
+		this->kinds[i].max_sample_id = UINT64_MAX;
+	}
+}
+
+//name in report
+const char *Diagnostics::getName(DiagnosticKind kind) {
+	switch (kind) {
+		case diagnostic_duplicate_points: return "duplicate_points";
+		case diagnostic_not_closed: return "not_closed";
+		case diagnostic_few_points: return "few_points";
+		case diagnostic_degenerated_triangle: return "degenerated_triangle";
+		case diagnostic_member_not_way: return "member_not_way";
+		case diagnostic_without_outer: return "without_outer";
+		default: return "unknown";
+	}
+}
+
+//description in summary, it follows count of issues
+const char *Diagnostics::getDescription(DiagnosticKind kind) {
+	switch (kind) {
+		case diagnostic_duplicate_points: return "polygons with two same points next to other";
+		case diagnostic_not_closed: return "polygons which aren't closed (they were closed)";
+		case diagnostic_few_points: return "polygons with less than 3 different points (ignored)";
+		case diagnostic_degenerated_triangle: return "triangles with two same points (skipped)";
+		case diagnostic_member_not_way: return "relations with inner or outer member which isn't way (member ignored)";
+		case diagnostic_without_outer: return "relations without any outer way (ignored)";
+		default: return "unknown issues";
+	}
+}
+
+//it's called from more threads; lock is taken only until sample of the kind is full
+void Diagnostics::add(DiagnosticKind kind, uint64_t id) {
+	Kind &diagnostic_kind = this->kinds[kind];
+	diagnostic_kind.count++;
+	if (id >= diagnostic_kind.max_sample_id) return;
+
+	lock_guard<mutex> guard(this->lock);
+	diagnostic_kind.sample_ids.insert(id);
+	if (diagnostic_kind.sample_ids.size() > DIAGNOSTICS_SAMPLE_IDS) diagnostic_kind.sample_ids.erase(--diagnostic_kind.sample_ids.end());
+	if (diagnostic_kind.sample_ids.size() == DIAGNOSTICS_SAMPLE_IDS) diagnostic_kind.max_sample_id = *diagnostic_kind.sample_ids.rbegin();
+}
+
+size_t Diagnostics::getCount() const {
+	size_t count = 0;
+	for (size_t i = 0; i < diagnostic_kinds_count; i++) count += this->kinds[i].count;
+	return count;
+}
+
+void Diagnostics::printSummary(ostream &os) {
+	lock_guard<mutex> guard(this->lock);
+	for (size_t i = 0; i < diagnostic_kinds_count; i++) {
+		const Kind &kind = this->kinds[i];
+		if (kind.count == 0) continue;
+		os << kind.count << " " << getDescription(static_cast<DiagnosticKind>(i)) << ", e.g. ids";
+		for (set<uint64_t>::const_iterator it = kind.sample_ids.begin(); it != kind.sample_ids.end(); it++) os << " " << *it;
+		os << "\n";
+	}
+	os << flush;
+}
+
+//JSON object with count and sample ids of every kind (also of kinds without issues)
+bool Diagnostics::writeReport(const char *filename) {
+	ofstream fs(filename);
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+
+	lock_guard<mutex> guard(this->lock);
+	fs << "{";
+	for (size_t i = 0; i < diagnostic_kinds_count; i++) {
+		const Kind &kind = this->kinds[i];
+		if (i > 0) fs << ",";
+		fs << GetJsonString(getName(static_cast<DiagnosticKind>(i))) << ":{\"count\":" << kind.count << ",\"sample_ids\":[";
+		for (set<uint64_t>::const_iterator it = kind.sample_ids.begin(); it != kind.sample_ids.end(); it++) {
+			if (it != kind.sample_ids.begin()) fs << ",";
+			fs << *it;
+		}
+		fs << "]}";
+	}
+	fs << "}\n";
+	return fs.good();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#define DIAGNOSTICS_SAMPLE_IDS 10		//ids kept for every kind of issue
+
+enum DiagnosticKind {
+	diagnostic_duplicate_points,
+	diagnostic_not_closed,
+	diagnostic_few_points,
+	diagnostic_degenerated_triangle,
+	diagnostic_member_not_way,
+	diagnostic_without_outer,
+	diagnostic_kinds_count
+};
+
+//Issues of input data found while writing scene (e.g. polygon which isn't closed). They are only counted by kind with
+//a few ids of features as sample, so drawing of messy data doesn't write a line to stderr for every issue. Summary is
+//printed at exit (not in quiet mode) and report can be written with --diagnostics.
+//Features in margins are drawn by more tiles of batch, so their issues are counted more times.
+class Diagnostics {
+	private:
+	struct Kind {
+		atomic<size_t> count;
+		atomic<uint64_t> max_sample_id;		//the largest of full sample, bigger ids are skipped without lock
+		set<uint64_t> sample_ids;		//the smallest ids, so sample doesn't depend on order of threads
+	};
+
+	Kind kinds[diagnostic_kinds_count];
+	mutex lock;		//guards sample ids
+
+	static const char *getName(DiagnosticKind kind);
+	static const char *getDescription(DiagnosticKind kind);
+
+	public:
+	Diagnostics();
+	void add(DiagnosticKind kind, uint64_t id);
+	size_t getCount() const;
+	void printSummary(ostream &os);
+	bool writeReport(const char *filename);
+};
+
+extern Diagnostics g_diagnostics;
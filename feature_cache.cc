@@ -0,0 +1,64 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "primitives.h"
+#include "feature_cache.h"
+
+CachedArea::CachedArea(const MultiPolygonSource &source, const Rect &unlimited_rect)
+ : source(source), multipolygon(source.relation, unlimited_rect) {
+}
+
+//it can be called from more tiles at once, the other ones wait until the first one assembles it
+void CachedArea::assemble() {
+	call_once(this->assembled, [this]() {
+		this->source.addToMultiPolygon(&this->multipolygon);
+		this->multipolygon.setDone();
+		if (this->multipolygon.isValid()) this->multipolygon.convertToTriangles(&this->triangles);
+	});
+}
+
+//triangles with bounding box intersecting rect
+void CachedArea::getTrianglesInRect(const Rect &rect, vector<Triangle> *output) const {
+	for (vector<Triangle>::const_iterator it = this->triangles.begin(); it != this->triangles.end(); it++) {
+		const Rect bounds = {
+			min(min(it->getY(0), it->getY(1)), it->getY(2)), min(min(it->getX(0), it->getX(1)), it->getX(2)),
+			max(max(it->getY(0), it->getY(1)), it->getY(2)), max(max(it->getX(0), it->getX(1)), it->getX(2))
+		};
+		if (bounds.intersects(rect)) output->push_back(*it);
+	}
+}
+
+FeatureCache::FeatureCache() : reused_count(0) {
+	this->unlimited_rect.minlat = -1000;
+	this->unlimited_rect.minlon = -1000;
+	this->unlimited_rect.maxlat = 1000;
+	this->unlimited_rect.maxlon = 1000;
+}
+
+//returns cached area or new one, which isn't assembled yet
+shared_ptr<CachedArea> FeatureCache::getArea(const MultiPolygonSource &source) {
+	Key key;
+	key.is_relation = (source.relation != NULL);
+	key.id = (key.is_relation ? source.relation->getId() : source.outer_ways.front()->getId());
+	key.version = (key.is_relation ? source.relation->getVersion() : source.outer_ways.front()->getVersion());
+
+	lock_guard<mutex> guard(this->lock);
+	map<Key,shared_ptr<CachedArea> >::iterator it = this->areas.find(key);
+	if (it != this->areas.end()) {
+		this->reused_count++;
+		return it->second;
+	}
+	shared_ptr<CachedArea> area(new CachedArea(source, this->unlimited_rect));
+	this->areas.insert(make_pair(key, area));
+	return area;
+}
+
+size_t FeatureCache::getAreasCount() {
+	lock_guard<mutex> guard(this->lock);
+	return this->areas.size();
+}
+
+size_t FeatureCache::getReusedCount() {
+	lock_guard<mutex> guard(this->lock);
+	return this->reused_count;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+
+//Multipolygon assembled without cropping to any tile and its triangles. They are computed only once, by the first
+//tile which needs them, and other tiles only clip them to their interest rectangle.
+class CachedArea {
+	private:
+	MultiPolygonSource source;
+	MultiPolygon multipolygon;
+	vector<Triangle> triangles;		//they point to points of multipolygon
+	once_flag assembled;
+
+	public:
+	CachedArea(const MultiPolygonSource &source, const Rect &unlimited_rect);
+	void assemble();
+	const MultiPolygon &getMultiPolygon() const { return this->multipolygon; }
+	void getTrianglesInRect(const Rect &rect, vector<Triangle> *output) const;
+};
+
+//Areas shared by all tiles of batch (--feature-cache). Tiles are extracted with big margins, so features near
+//borders of tiles (and big forests or riverbanks over many tiles) would be assembled and triangulated again for
+//every tile. Area is found by id and version of its relation (or of closed way), so changed data aren't taken from
+//cache. Areas are kept until the end of batch.
+class FeatureCache {
+	private:
+	struct Key {
+		bool is_relation;
+		uint64_t id;
+		uint32_t version;
+
+		bool operator<(const Key &other) const {
+			if (this->is_relation != other.is_relation) return (this->is_relation < other.is_relation);
+			if (this->id != other.id) return (this->id < other.id);
+			return (this->version < other.version);
+		}
+	};
+
+	Rect unlimited_rect;		//multipolygons aren't cropped by it
+	map<Key,shared_ptr<CachedArea> > areas;
+	size_t reused_count;
+	mutex lock;		//guards everything above
+
+	public:
+	FeatureCache();
+	shared_ptr<CachedArea> getArea(const MultiPolygonSource &source);
+	size_t getAreasCount();
+	size_t getReusedCount();
+};
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <cstdint>
 #include <cstdio>
@@ -9,6 +10,7 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include <set>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
@@ -20,5 +22,6 @@
 using namespace std;
 
 #define COMP_PRECISION 0.000000001
+#define DEFAULT_ZOOM 12		//zoom of tiles (and scale of output) when it isn't set; Y coords of tiles are divided by 2
 
 extern bool g_quiet_mode;
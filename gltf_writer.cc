@@ -0,0 +1,106 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "gltf_writer.h"
+#include "primitives.h"
+
+#define GLB_MAGIC 0x46546C67		//"glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+#define GL_ARRAY_BUFFER 34962
+#define GL_ELEMENT_ARRAY_BUFFER 34963
+#define GL_FLOAT 5126
+#define GL_UNSIGNED_INT 5125
+
+GltfWriter::GltfWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom)
+ : MeshWriter(filename, view_rect, fix_size_to_square, zoom, ios_base::out | ios_base::binary) {
+}
+
+GltfWriter::~GltfWriter() {
+	if (this->fs.is_open()) this->close();		//writeMeshes() can't be called from destructor of MeshWriter
+}
+
+void GltfWriter::writeUint32(uint32_t value) {		//glTF is always little endian
+	const char bytes[4] = { (char)(value & 0xFF), (char)((value >> 8) & 0xFF), (char)((value >> 16) & 0xFF), (char)((value >> 24) & 0xFF) };
+	this->fs.write(bytes, 4);
+}
+
+static string EscapeJson(const string &text) {
+	string output;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\') output += '\\';
+		output += text[i];
+	}
+	return output;
+}
+
+void GltfWriter::writeMeshes() {
+	stringstream json, nodes, meshes, materials, buffer_views, accessors;
+	accessors.precision(9);
+
+	size_t mesh_count = 0;
+	uint32_t bin_length = 0;
+	for (map<string,MeshBuffer>::const_iterator it = this->meshes.begin(); it != this->meshes.end(); it++) {
+		const MeshBuffer &mesh = it->second;
+		if (mesh.indices.empty()) continue;
+		const string name = EscapeJson(it->first);
+		const size_t vertices = mesh.positions.size()/3;
+		const char *comma = (mesh_count == 0 ? "" : ",");
+
+		float min[3] = { mesh.positions[0], mesh.positions[1], mesh.positions[2] };
+		float max[3] = { mesh.positions[0], mesh.positions[1], mesh.positions[2] };
+		for (size_t i = 0; i < mesh.positions.size(); i++) {
+			if (mesh.positions[i] < min[i%3]) min[i%3] = mesh.positions[i];
+			if (mesh.positions[i] > max[i%3]) max[i%3] = mesh.positions[i];
+		}
+
+		nodes << comma << "{\"mesh\":" << mesh_count << ",\"name\":\"" << name << "\"}";
+		meshes << comma << "{\"name\":\"" << name << "\",\"primitives\":[{\"attributes\":{\"POSITION\":" << mesh_count*2 << "},\"indices\":" << mesh_count*2+1 << ",\"material\":" << mesh_count << "}]}";
+		materials << comma << "{\"name\":\"" << name << "\",\"doubleSided\":true,\"pbrMetallicRoughness\":{\"metallicFactor\":0}}";
+
+		buffer_views << comma << "{\"buffer\":0,\"byteOffset\":" << bin_length << ",\"byteLength\":" << mesh.positions.size()*4 << ",\"target\":" << GL_ARRAY_BUFFER << "}";
+		bin_length += mesh.positions.size()*4;
+		buffer_views << ",{\"buffer\":0,\"byteOffset\":" << bin_length << ",\"byteLength\":" << mesh.indices.size()*4 << ",\"target\":" << GL_ELEMENT_ARRAY_BUFFER << "}";
+		bin_length += mesh.indices.size()*4;
+
+		accessors << comma << "{\"bufferView\":" << mesh_count*2 << ",\"componentType\":" << GL_FLOAT << ",\"count\":" << vertices << ",\"type\":\"VEC3\"";
+		accessors << ",\"min\":[" << min[0] << "," << min[1] << "," << min[2] << "],\"max\":[" << max[0] << "," << max[1] << "," << max[2] << "]}";
+		accessors << ",{\"bufferView\":" << mesh_count*2+1 << ",\"componentType\":" << GL_UNSIGNED_INT << ",\"count\":" << mesh.indices.size() << ",\"type\":\"SCALAR\"}";
+
+		mesh_count++;
+	}
+
+	json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"osm2pov\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+	for (size_t i = 0; i < mesh_count; i++) json << (i == 0 ? "" : ",") << i;
+	json << "]}],\"nodes\":[" << nodes.str() << "],\"meshes\":[" << meshes.str() << "],\"materials\":[" << materials.str() << "]";
+	if (bin_length > 0) {
+		json << ",\"buffers\":[{\"byteLength\":" << bin_length << "}],\"bufferViews\":[" << buffer_views.str() << "],\"accessors\":[" << accessors.str() << "]";
+	}
+	json << "}";
+
+	string json_chunk = json.str();
+	while (json_chunk.size() % 4 != 0) json_chunk += ' ';		//chunks must be aligned to 4 bytes
+
+	//header
+	writeUint32(GLB_MAGIC);
+	writeUint32(2);
+	writeUint32(12 + 8 + json_chunk.size() + (bin_length > 0 ? 8 + bin_length : 0));
+
+	writeUint32(json_chunk.size());
+	writeUint32(GLB_CHUNK_JSON);
+	this->fs.write(json_chunk.c_str(), json_chunk.size());
+
+	if (bin_length == 0) return;
+	writeUint32(bin_length);
+	writeUint32(GLB_CHUNK_BIN);
+	for (map<string,MeshBuffer>::const_iterator it = this->meshes.begin(); it != this->meshes.end(); it++) {
+		const MeshBuffer &mesh = it->second;
+		if (mesh.indices.empty()) continue;
+		for (size_t i = 0; i < mesh.positions.size(); i++) {
+			uint32_t bits;
+			memcpy(&bits, &mesh.positions[i], 4);
+			writeUint32(bits);
+		}
+		for (size_t i = 0; i < mesh.indices.size(); i++) writeUint32(mesh.indices[i]);
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "mesh_writer.h"
+
+//Writer to binary glTF 2.0 (.glb) - one mesh with own material for each style
+class GltfWriter : public MeshWriter {
+	private:
+	void writeUint32(uint32_t value);
+	void writeMeshes();
+
+	public:
+	GltfWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom);
+	~GltfWriter();
+};
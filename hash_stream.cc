@@ -0,0 +1,67 @@
+
+#include "global.h"
+#include "hash_stream.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+HashingOfstream::HashingStreamBuf::HashingStreamBuf() : hash(FNV_OFFSET_BASIS), flushed_bytes(0) {
+	this->setp(this->buffer, this->buffer+sizeof(this->buffer));
+}
+
+//hashes buffered data and writes them to file
+bool HashingOfstream::HashingStreamBuf::flushBuffer() {
+	const streamsize size = this->pptr()-this->pbase();
+	for (const char *c = this->pbase(); c != this->pptr(); c++) {
+		this->hash ^= static_cast<unsigned char>(*c);
+		this->hash *= FNV_PRIME;
+	}
+	this->pbump(-size);
+	this->flushed_bytes += size;
+	return (this->file.sputn(this->pbase(), size) == size);
+}
+
+int HashingOfstream::HashingStreamBuf::overflow(int c) {
+	if (!this->flushBuffer()) return traits_type::eof();
+	if (c != traits_type::eof()) {
+		*this->pptr() = c;
+		this->pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+int HashingOfstream::HashingStreamBuf::sync() {
+	return (this->flushBuffer() && this->file.pubsync() == 0 ? 0 : -1);
+}
+
+void HashingOfstream::open(const char *filename, ios_base::openmode mode) {
+	if (this->buf.file.open(filename, mode | ios_base::out) == NULL) this->setstate(ios_base::failbit);
+	else this->clear();
+}
+
+void HashingOfstream::close() {
+	if (!this->buf.flushBuffer() || this->buf.file.close() == NULL) this->setstate(ios_base::failbit);
+}
+
+uint64_t HashingOfstream::getHash() {
+	if (this->buf.file.is_open()) this->flush();
+	return this->buf.hash;
+}
+
+string FormatHash(uint64_t hash) {
+	char str[17];
+	snprintf(str, sizeof(str), "%016llx", static_cast<unsigned long long>(hash));
+	return str;
+}
+
+//writes hash of output to file with name of output and extension .hash
+bool WriteHashFile(const char *output_filename, uint64_t hash) {
+	const string filename = string(output_filename) + ".hash";
+	ofstream fs(filename.c_str());
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+	fs << FormatHash(hash) << endl;
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+//Output file which computes 64-bit FNV-1a hash of all data written to it. Hash is written next to output file
+//(see WriteHashFile()), so it's possible to find out that output hasn't changed and skip rendering it again.
+class HashingOfstream : public ostream {
+	private:
+	class HashingStreamBuf : public streambuf {
+		private:
+		char buffer[8192];
+
+		protected:
+		int overflow(int c);
+		int sync();
+
+		public:
+		filebuf file;
+		uint64_t hash;
+		uint64_t flushed_bytes;
+
+		HashingStreamBuf();
+		bool flushBuffer();
+		uint64_t getBytesWritten() const {
+			return this->flushed_bytes + (this->pptr()-this->pbase());
+		}
+	};
+
+	HashingStreamBuf buf;
+
+	public:
+	HashingOfstream() : ostream(NULL) {
+		this->init(&this->buf);
+	}
+	void open(const char *filename, ios_base::openmode mode = ios_base::out);
+	bool is_open() const {
+		return this->buf.file.is_open();
+	}
+	void close();
+	uint64_t getHash();
+	uint64_t getBytesWritten() const {
+		return this->buf.getBytesWritten();
+	}
+};
+
+string FormatHash(uint64_t hash);
+bool WriteHashFile(const char *output_filename, uint64_t hash);
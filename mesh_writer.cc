@@ -0,0 +1,249 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "mesh_writer.h"
+#include "primitives.h"
+#include "trace.h"
+
+#define CYLINDER_SEGMENTS 12
+
+MeshWriter::MeshWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom, ios_base::openmode mode)
+ : SceneWriter(view_rect, fix_size_to_square, zoom), filename(filename) {
+	this->fs.open(filename, mode);
+	if (!this->fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+	}
+}
+
+bool MeshWriter::close() {
+	TraceSpan trace_span("writer", "flush");
+	this->writeMeshes();
+	this->fs.close();
+	if (!this->fs) {
+		cerr << "Cannot write " << this->filename << "!" << endl;
+		return false;
+	}
+	return true;
+}
+
+//bytes are size of buffered vertices and indices, the file is written at end
+SceneCounters MeshWriter::getCounters() const {
+	SceneCounters counters = this->counters;
+	for (map<string,MeshBuffer>::const_iterator it = this->meshes.begin(); it != this->meshes.end(); it++) {
+		counters.bytes += (it->second.positions.size() + it->second.indices.size()) * 4;
+	}
+	return counters;
+}
+
+MeshWriter::MeshBuffer &MeshWriter::getMesh(const char *style) {
+	return this->meshes[style];
+}
+
+//x, y and z are in POV-Ray system (left-handed, z is north)
+uint32_t MeshWriter::addVertex(MeshBuffer *mesh, double x, double y, double z) {
+	const uint32_t index = mesh->positions.size()/3;
+	mesh->positions.push_back(x);
+	mesh->positions.push_back(y);
+	mesh->positions.push_back(-z);
+	return index;
+}
+
+void MeshWriter::addTriangle(MeshBuffer *mesh, uint32_t a, uint32_t b, uint32_t c) {
+	mesh->indices.push_back(a);
+	mesh->indices.push_back(b);
+	mesh->indices.push_back(c);
+}
+
+void MeshWriter::writePolygon(uint64_t /*id*/, const vector<Triangle> &triangles, double height, const char *style) {
+	MeshBuffer &mesh = this->getMesh(style);
+	const double y = this->convertMetresToCoord(height);
+
+	map<pair<double,double>,uint32_t> vertices;		//point shared by more triangles of polygon is one vertex
+	for (vector<Triangle>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+		double x[3], z[3];
+		for (size_t i = 0; i < 3; i++) {
+			x[i] = this->convertLonToCoord(it->getX(i));
+			z[i] = this->convertLatToCoord(it->getY(i));
+		}
+
+		bool degenerated = false;		//the same check as in PovWriter::writeTriangle()
+		for (size_t i = 0; i < 3; i++) {
+			if (x[i] <= x[(i+1)%3]+COMP_PRECISION && x[i] >= x[(i+1)%3]-COMP_PRECISION
+			 && z[i] <= z[(i+1)%3]+COMP_PRECISION && z[i] >= z[(i+1)%3]-COMP_PRECISION) degenerated = true;
+		}
+		if (degenerated) continue;
+
+		uint32_t indexes[3];
+		for (size_t i = 0; i < 3; i++) {
+			const pair<double,double> point(x[i], z[i]);
+			map<pair<double,double>,uint32_t>::const_iterator vertex_it = vertices.find(point);
+			if (vertex_it == vertices.end()) vertex_it = vertices.insert(make_pair(point, addVertex(&mesh, x[i], y, z[i]))).first;
+			indexes[i] = vertex_it->second;
+		}
+		addTriangle(&mesh, indexes[0], indexes[1], indexes[2]);
+		this->counters.triangles++;
+	}
+}
+
+static bool IsPointInTriangle2D(const double *p, const double *a, const double *b, const double *c) {
+	const double d1 = (p[0]-b[0])*(a[1]-b[1]) - (a[0]-b[0])*(p[1]-b[1]);
+	const double d2 = (p[0]-c[0])*(b[1]-c[1]) - (b[0]-c[0])*(p[1]-c[1]);
+	const double d3 = (p[0]-a[0])*(c[1]-a[1]) - (c[0]-a[0])*(p[1]-a[1]);
+	return (d1 < 0 && d2 < 0 && d3 < 0) || (d1 > 0 && d2 > 0 && d3 > 0);
+}
+
+//Polygon3D is planar (horizontal area or vertical wall) but can be concave, so it's triangulated by ear clipping
+//in the plane where it has the biggest projection
+void MeshWriter::writePolygon(const Polygon3D &polygon, const char *style) {
+	if (!polygon.isValidPolygon()) return;
+
+	const vector<double> &points = polygon.getPoints();
+	size_t count = points.size()/3;
+	if (count > 1 && points[0] == points[count*3-3] && points[1] == points[count*3-2] && points[2] == points[count*3-1])
+		count--;		//closing point
+	if (count < 3) return;
+
+	double normal[3] = { 0, 0, 0 };		//Newell's method
+	for (size_t i = 0; i < count; i++) {
+		const double *p = &points[i*3], *q = &points[((i+1)%count)*3];
+		normal[0] += (p[1]-q[1])*(p[2]+q[2]);
+		normal[1] += (p[2]-q[2])*(p[0]+q[0]);
+		normal[2] += (p[0]-q[0])*(p[1]+q[1]);
+	}
+	size_t drop_axis = 0;
+	for (size_t i = 1; i < 3; i++) {
+		if (fabs(normal[i]) > fabs(normal[drop_axis])) drop_axis = i;
+	}
+	const size_t axis_u = (drop_axis+1)%3, axis_v = (drop_axis+2)%3;
+	const bool reversed = (normal[drop_axis] < 0);
+
+	vector<double> points_2d(count*2);
+	for (size_t i = 0; i < count; i++) {
+		points_2d[i*2] = points[i*3+axis_u];
+		points_2d[i*2+1] = points[i*3+axis_v];
+	}
+
+	MeshBuffer &mesh = this->getMesh(style);
+	this->counters.polygons++;
+	vector<uint32_t> vertices(count);
+	for (size_t i = 0; i < count; i++) vertices[i] = addVertex(&mesh, points[i*3], points[i*3+1], points[i*3+2]);
+
+	list<size_t> remaining;		//positions of not yet clipped points, in counterclockwise order
+	for (size_t i = 0; i < count; i++) {
+		if (reversed) remaining.push_front(i);
+		else remaining.push_back(i);
+	}
+
+	size_t fails = 0;
+	list<size_t>::iterator it = remaining.begin();
+	while (remaining.size() > 3) {
+		list<size_t>::iterator prev_it = (it == remaining.begin() ? --remaining.end() : prev(it));
+		list<size_t>::iterator next_it = (next(it) == remaining.end() ? remaining.begin() : next(it));
+		const double *a = &points_2d[*prev_it*2], *b = &points_2d[*it*2], *c = &points_2d[*next_it*2];
+
+		bool is_ear = ((b[0]-a[0])*(c[1]-a[1]) - (b[1]-a[1])*(c[0]-a[0]) > 0);
+		for (list<size_t>::const_iterator it2 = remaining.begin(); is_ear && it2 != remaining.end(); it2++) {
+			if (it2 == prev_it || it2 == it || it2 == next_it) continue;
+			if (IsPointInTriangle2D(&points_2d[*it2*2], a, b, c)) is_ear = false;
+		}
+
+		if (is_ear || fails > remaining.size()) {		//when no ear is found (degenerated polygon), clip anyway
+			addTriangle(&mesh, vertices[*prev_it], vertices[*it], vertices[*next_it]);
+			remaining.erase(it);
+			it = next_it;
+			fails = 0;
+		}
+		else {
+			it = next_it;
+			fails++;
+		}
+	}
+	list<size_t>::const_iterator last = remaining.begin();
+	const uint32_t a = vertices[*last++];
+	const uint32_t b = vertices[*last++];
+	addTriangle(&mesh, a, b, vertices[*last]);
+}
+
+void MeshWriter::writeMesh(const Mesh &mesh) {
+	const vector<double> &vertices = mesh.getVertices();
+	const vector<size_t> &faces = mesh.getFaces();
+	const vector<const char*> &styles = mesh.getStyles();
+	this->counters.triangles += mesh.getTrianglesCount();
+
+	for (size_t style_index = 0; style_index < styles.size(); style_index++) {
+		MeshBuffer &buffer = this->getMesh(styles[style_index]);
+		map<size_t,uint32_t> buffer_vertices;		//vertex in mesh -> vertex in buffer
+		for (size_t i = 0; i < faces.size(); i += 4) {
+			if (faces[i+3] != style_index) continue;
+			uint32_t triangle[3];
+			for (size_t j = 0; j < 3; j++) {
+				const size_t vertex = faces[i+j];
+				map<size_t,uint32_t>::const_iterator it = buffer_vertices.find(vertex);
+				if (it != buffer_vertices.end()) triangle[j] = it->second;
+				else triangle[j] = buffer_vertices[vertex] = addVertex(&buffer, vertices[vertex*3], vertices[vertex*3+1], vertices[vertex*3+2]);
+			}
+			addTriangle(&buffer, triangle[0], triangle[1], triangle[2]);
+		}
+	}
+}
+
+//box as in POV-Ray: box { <0,0,-width/2>, <length,height,width/2> rotate <0,angle,0> translate <x,0,y> }
+void MeshWriter::writeBox(double x, double y, double width, double height, double length, double angle, const char *style) {
+	MeshBuffer &mesh = this->getMesh(style);
+	this->counters.boxes++;
+	const double sin_angle = sin(angle * M_PI / 180), cos_angle = cos(angle * M_PI / 180);
+
+	uint32_t corners[8];
+	for (size_t i = 0; i < 8; i++) {
+		const double box_x = (i & 1 ? length : 0);
+		const double box_y = (i & 2 ? height : 0);
+		const double box_z = (i & 4 ? width/2 : -width/2);
+		corners[i] = addVertex(&mesh, box_x*cos_angle + box_z*sin_angle + x, box_y, -box_x*sin_angle + box_z*cos_angle + y);
+	}
+
+	static const uint32_t faces[6][4] = { {0,1,3,2}, {4,6,7,5}, {0,4,5,1}, {2,3,7,6}, {0,2,6,4}, {1,5,7,3} };
+	for (size_t i = 0; i < 6; i++) {
+		addTriangle(&mesh, corners[faces[i][0]], corners[faces[i][1]], corners[faces[i][2]]);
+		addTriangle(&mesh, corners[faces[i][0]], corners[faces[i][2]], corners[faces[i][3]]);
+	}
+}
+
+void MeshWriter::writeCylinder(double x, double y, double radius, double height, const char *style) {
+	MeshBuffer &mesh = this->getMesh(style);
+	this->counters.cylinders++;
+
+	const uint32_t bottom_center = addVertex(&mesh, x, 0, y);
+	const uint32_t top_center = addVertex(&mesh, x, height, y);
+	uint32_t first = 0;
+	for (size_t i = 0; i < CYLINDER_SEGMENTS; i++) {
+		const double angle = 2 * M_PI * i / CYLINDER_SEGMENTS;
+		const uint32_t bottom = addVertex(&mesh, x + radius*cos(angle), 0, y + radius*sin(angle));
+		addVertex(&mesh, x + radius*cos(angle), height, y + radius*sin(angle));
+		if (i == 0) first = bottom;
+	}
+	for (size_t i = 0; i < CYLINDER_SEGMENTS; i++) {
+		const uint32_t bottom = first + i*2, top = bottom + 1;
+		const uint32_t next_bottom = first + ((i+1) % CYLINDER_SEGMENTS)*2, next_top = next_bottom + 1;
+		addTriangle(&mesh, bottom, next_bottom, next_top);
+		addTriangle(&mesh, bottom, next_top, top);
+		addTriangle(&mesh, top_center, top, next_top);
+		addTriangle(&mesh, bottom_center, next_bottom, bottom);
+	}
+}
+
+//sprite as in POV-Ray: vertical square with side 1 scaled by scale, centered at x
+void MeshWriter::writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale) {
+	stringstream style;
+	style << sprite_style << sprite_style_number;
+	MeshBuffer &mesh = this->getMesh(style.str().c_str());
+	this->counters.sprites++;
+
+	scale *= this->zoom_scale;
+	const double coord_x = this->convertLonToCoord(x), coord_y = this->convertLatToCoord(y);
+	const uint32_t a = addVertex(&mesh, coord_x - scale/2, 0, coord_y);
+	const uint32_t b = addVertex(&mesh, coord_x + scale/2, 0, coord_y);
+	const uint32_t c = addVertex(&mesh, coord_x + scale/2, scale, coord_y);
+	const uint32_t d = addVertex(&mesh, coord_x - scale/2, scale, coord_y);
+	addTriangle(&mesh, a, b, c);
+	addTriangle(&mesh, a, c, d);
+}
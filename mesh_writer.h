@@ -0,0 +1,39 @@
+#pragma once
+
+#include "scene_writer.h"
+
+//Base of writers to triangle mesh formats. All objects are batched into one indexed buffer per material (style)
+//and they are written to file at once when writer is closed (see writeMeshes()).
+//Coords are converted to right-handed system with Y up (north is -Z) used by mesh formats.
+class MeshWriter : public SceneWriter {
+	protected:
+	struct MeshBuffer {
+		vector<float> positions;		//x,y,z of each vertex
+		vector<uint32_t> indices;		//three indices for each triangle
+	};
+
+	ofstream fs;
+	string filename;
+	map<string,MeshBuffer> meshes;		//ordered by material name, so output doesn't depend on order of objects
+
+	MeshBuffer &getMesh(const char *style);
+	static uint32_t addVertex(MeshBuffer *mesh, double x, double y, double z);
+	static void addTriangle(MeshBuffer *mesh, uint32_t a, uint32_t b, uint32_t c);
+
+	virtual void writeMeshes() = 0;
+
+	public:
+	MeshWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom, ios_base::openmode mode);
+	bool isOpened() const {
+		return (this->fs.is_open());
+	}
+	bool close();
+	SceneCounters getCounters() const;
+	void writeComment(const char */*comment*/) { }
+	void writePolygon(uint64_t id, const vector<Triangle> &triangles, double height, const char *style);
+	void writePolygon(const Polygon3D &polygon, const char *style);
+	void writeMesh(const Mesh &mesh);
+	void writeBox(double x, double y, double width, double height, double length, double angle, const char *style);
+	void writeCylinder(double x, double y, double radius, double height, const char *style);
+	void writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale);
+};
@@ -0,0 +1,94 @@
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "primitives.h"
+#include "node_store.h"
+
+#define LAT_OFFSET 1000000000		//lat is from -90 to 90 degrees, so stored value is never 0
+#define MIN_CAPACITY (1 << 20)
+#define MAX_NODE_ID (1ULL << 36)		//much more than ids used in OSM, bigger ids are probably negative ids of new nodes
+
+static int32_t DegreesToFixed(float degrees) {
+	return (int32_t)lround(degrees * 1e7);
+}
+
+static float FixedToDegrees(int32_t fixed) {
+	return fixed / 1e7;
+}
+
+NodeStore::NodeStore() {
+	this->fd = -1;
+	this->locations = NULL;
+	this->capacity = 0;
+	this->locations_count = 0;
+	this->bounds.minlat = 10000;		//some nonsens
+	this->bounds.maxlat = -10000;
+	this->bounds.minlon = 10000;
+	this->bounds.maxlon = -10000;
+}
+
+NodeStore::~NodeStore() {
+	if (this->locations != NULL) munmap(this->locations, this->capacity * sizeof(Location));
+	if (this->fd != -1) close(this->fd);
+}
+
+bool NodeStore::open(const char *filename) {
+	this->fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (this->fd == -1) {
+		cerr << "Cannot open node store " << filename << "!" << endl;
+		return false;
+	}
+	unlink(filename);
+	return this->grow(MIN_CAPACITY);
+}
+
+//file is enlarged (without writing anything, so it stays sparse) and mapped again
+bool NodeStore::grow(uint64_t min_capacity) {
+	uint64_t capacity = max<uint64_t>(this->capacity, MIN_CAPACITY);
+	while (capacity < min_capacity) capacity *= 2;
+
+	if (ftruncate(this->fd, capacity * sizeof(Location)) != 0) {
+		cerr << "Cannot enlarge node store to " << capacity << " nodes!" << endl;
+		return false;
+	}
+	void *locations = mmap(NULL, capacity * sizeof(Location), PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+	if (locations == MAP_FAILED) {
+		cerr << "Cannot map node store to memory!" << endl;
+		return false;
+	}
+
+	if (this->locations != NULL) munmap(this->locations, this->capacity * sizeof(Location));
+	this->locations = static_cast<Location*>(locations);
+	this->capacity = capacity;
+	return true;
+}
+
+//it must not be called at once with other methods (file can be mapped again)
+bool NodeStore::setLocation(uint64_t id, float lat, float lon) {
+	if (id >= MAX_NODE_ID) {
+		cerr << "Node with id " << id << " can't be saved to node store!" << endl;
+		return false;
+	}
+	if (id >= this->capacity && !this->grow(id+1)) return false;
+
+	Location &location = this->locations[id];
+	if (location.lat == 0) this->locations_count++;
+	location.lat = DegreesToFixed(lat) + LAT_OFFSET;
+	location.lon = DegreesToFixed(lon);
+
+	if (lat < this->bounds.minlat) this->bounds.minlat = lat;
+	if (lat > this->bounds.maxlat) this->bounds.maxlat = lat;
+	if (lon < this->bounds.minlon) this->bounds.minlon = lon;
+	if (lon > this->bounds.maxlon) this->bounds.maxlon = lon;
+	return true;
+}
+
+bool NodeStore::getLocation(uint64_t id, float *lat, float *lon) const {
+	if (!this->hasLocation(id)) return false;
+	*lat = FixedToDegrees(this->locations[id].lat - LAT_OFFSET);
+	*lon = FixedToDegrees(this->locations[id].lon);
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//Locations of nodes in file mapped to memory, so they don't have to fit into RAM. Location is stored at position given
+//by id of node (as lat and lon in 32-bit fixed point), so the file is sparse and it takes place on disk only for ranges
+//of ids which are really used. Only pages used recently are in memory and the system swaps them out as needed.
+//File is deleted right after it's opened, it exists only while the store is opened.
+class NodeStore {
+	private:
+	struct Location {
+		int32_t lat;		//lat+LAT_OFFSET in 1e-7 degrees, so 0 means that location isn't set
+		int32_t lon;
+	};
+
+	int fd;
+	Location *locations;
+	uint64_t capacity;		//count of locations in the file
+	size_t locations_count;
+	Rect bounds;		//bounding box of all locations
+
+	bool grow(uint64_t min_capacity);
+
+	public:
+	NodeStore();
+	~NodeStore();
+	bool open(const char *filename);
+	bool setLocation(uint64_t id, float lat, float lon);
+	bool getLocation(uint64_t id, float *lat, float *lon) const;
+	bool hasLocation(uint64_t id) const {
+		return (id < this->capacity && this->locations[id].lat != 0);
+	}
+	size_t getLocationsCount() const { return this->locations_count; }
+	Rect getBounds() const { return this->bounds; }
+	uint64_t getMappedBytes() const { return this->capacity * sizeof(Location); }
+};
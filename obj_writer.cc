@@ -0,0 +1,34 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "obj_writer.h"
+#include "primitives.h"
+
+
+ObjWriter::ObjWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom)
+ : MeshWriter(filename, view_rect, fix_size_to_square, zoom, ios_base::out) {
+	if (this->fs) {
+		this->fs.precision(9);
+		this->fs << "# Generated by osm2pov" << endl;
+	}
+}
+
+ObjWriter::~ObjWriter() {
+	if (this->fs.is_open()) this->close();		//writeMeshes() can't be called from destructor of MeshWriter
+}
+
+void ObjWriter::writeMeshes() {
+	size_t vertices_before = 1;		//indices in OBJ are global and starts by 1
+	for (map<string,MeshBuffer>::const_iterator it = this->meshes.begin(); it != this->meshes.end(); it++) {
+		const MeshBuffer &mesh = it->second;
+		this->fs << "g " << it->first << "\n";
+		this->fs << "usemtl " << it->first << "\n";
+		for (size_t i = 0; i < mesh.positions.size(); i += 3) {
+			this->fs << "v " << mesh.positions[i] << " " << mesh.positions[i+1] << " " << mesh.positions[i+2] << "\n";
+		}
+		for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+			this->fs << "f " << (mesh.indices[i]+vertices_before) << " " << (mesh.indices[i+1]+vertices_before) << " " << (mesh.indices[i+2]+vertices_before) << "\n";
+		}
+		vertices_before += mesh.positions.size()/3;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "mesh_writer.h"
+
+//Writer to Wavefront OBJ format - one group with own material for each style
+class ObjWriter : public MeshWriter {
+	private:
+	void writeMeshes();
+
+	public:
+	ObjWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom);
+	~ObjWriter();
+};
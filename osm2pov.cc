@@ -14,32 +14,372 @@
 #include "point_field.h"
 #include "osm2pov_converter.h"
 #include "output_polygon.h"
+#include "diagnostics.h"
+#include "gltf_writer.h"
+#include "obj_writer.h"
 #include "pov_writer.h"
 #include "primitives.h"
+#include "feature_cache.h"
+#include "render_cost.h"
+#include "render_jobs.h"
+#include "render_server.h"
+#include "scene_index.h"
+#include "stats.h"
+#include "trace.h"
+#include "task_pool.h"
+
+#define NODE_STORE_TILES_PER_THREAD 8		//batch tiles written at once with node store, nodes created from it are released after them
+#define NODE_STORE_DAEMON_NODES 10000000		//daemon waits for release of nodes created from node store when there are more of them
 
 bool g_quiet_mode = false;
 
 static void PrintHelpAndExit() {
 	cout << "Osm2Pov " << VERSION;
 	cout << "\tAuthor Aleš Janda | See http://osm.kyblsoft.cz/3dmapa/info for details" << endl << endl;
-	cout << "Using:\tosm2pov [-q] input.osm output.pov [X Y]" << endl;
-	cout << "\t-q means \"quiet\" - suppress common errors and no standard output" << endl << endl;
+	cout << "Using:\tosm2pov [options] input.osm output.pov [X Y]" << endl;
+	cout << "\tosm2pov [options] --tiles X1 Y1 X2 Y2 input.osm output-%x-%y.pov" << endl;
+	cout << "\tosm2pov [options] --tile-list tiles.txt input.osm output-%x-%y.pov" << endl;
+	cout << "\tosm2pov --update changes.osc --affected-tiles tiles.txt --save-snapshot input.snapshot input.snapshot" << endl;
+	cout << "\tosm2pov [options] --daemon socket input.osm" << endl;
+	cout << "\t-q means \"quiet\" - suppress common errors and no standard output" << endl;
+	cout << "\t--chunks N - split POV scene by grid NxN into unions with bounding boxes" << endl;
+	cout << "\t--chunk-files - write every chunk to separate include file (output-chunk-X-Y.inc)" << endl;
+	cout << "\t--tiles X1 Y1 X2 Y2 - write all tiles in the range (inclusive), input file is loaded only once" << endl;
+	cout << "\t--tile-list FILE - write tiles listed in file as pairs \"X Y\"" << endl;
+	cout << "\t--zoom Z - X and Y are coords of tiles of zoom Z (Y is divided by 2 too), default is 12" << endl;
+	cout << "\t-j N - use N threads for writing tiles and geometry of features (default is number of CPU cores)" << endl;
+	cout << "\t--daemon SOCKET - keep data loaded and write tiles requested on Unix socket by lines \"tile X Y [ZOOM] [PATH]\"" << endl;
+	cout << "\t--update FILE.osc - apply osmChange file to loaded data (can be used more times)" << endl;
+	cout << "\t--affected-tiles FILE - write tiles changed by updates to file as pairs \"X Y\" (for --tile-list)" << endl;
+	cout << "\t--save-snapshot FILE - save loaded (and updated) data to binary snapshot, which can be used as input file" << endl;
+	cout << "\t--node-store FILE - keep locations of nodes in file instead of memory (for very big OSM files)" << endl;
+	cout << "\t--drop-unused - after loading, drop data which can't be drawn in written tiles, so queries of tiles don't scan it" << endl;
+	cout << "\t--stats FORMAT - print time and memory of phases, estimated memory of loaded data and counters of every draw rule at exit, FORMAT is table or json" << endl;
+	cout << "\t--trace FILE - write spans of phases, draw rules, slow features and writing of files to FILE as Chrome trace events (JSON)" << endl;
+	cout << "\t--cost-report - write counts of objects and estimated cost of rendering next to every POV output (OUTPUT.cost)" << endl;
+	cout << "\t--cost-model FILE - weights of objects for estimated cost of rendering (it implies --cost-report)" << endl;
+	cout << "\t--render COMMAND - in batch mode run COMMAND for every written tile, the heaviest tiles first (%x, %y and %f are replaced by coords and file of tile)" << endl;
+	cout << "\t--render-jobs N - run at most N render commands at once (default is 1)" << endl;
+	cout << "\t--render-attempts N - run failed render command at most N times (default is 3)" << endl;
+	cout << "\t--journal FILE - in batch mode append done tiles to FILE and skip tiles which are in it (resume of interrupted run)" << endl;
+	cout << "\t--feature-cache - in batch mode assemble and triangulate every area only once and share it by all tiles" << endl;
+	cout << "\t--comments - write comment with OSM id and tag before objects of every feature (only to POV output)" << endl;
+	cout << "\t--index - write OSM ids and draw rules of written objects next to every output (OUTPUT.index.csv)" << endl;
+	cout << "\t--diagnostics FILE - write counts and sample ids of issues in input data (e.g. polygons which aren't closed) to FILE as JSON" << endl << endl;
+	cout << "Format of output is chosen by its extension: .pov (POV-Ray scene), .obj (Wavefront OBJ) or .glb (binary glTF)." << endl;
 	cout << "By default, area is computed from OSM file. If you can use it for render part of bigger map, set X and Y parameters. These are coords of tiles of zoom 12, where Y is divided by 2." << endl;
-	cout << "Currently, zoom of output model (and image) is always the same." << endl;
+	cout << "Output of every tile has the same size, so the image of tile in lower zoom covers bigger area. Trees and other small objects are left out in zooms lower than 11." << endl;
 	exit(1);
 }
 
+static bool HasExtension(const char *filename, const char *extension) {
+	const size_t filename_len = strlen(filename), extension_len = strlen(extension);
+	return (filename_len > extension_len && strcasecmp(filename+filename_len-extension_len, extension) == 0);
+}
+
+//whole argument must be a number which is at least 1, otherwise help is printed
+static size_t ParsePositiveCount(const char *arg) {
+	char *end;
+	const long count = strtol(arg, &end, 10);
+	if (end == arg || *end != '\0' || count < 1) PrintHelpAndExit();
+	return count;
+}
+
+static bool IsZoomValid(int zoom) {
+	return (zoom >= 1 && zoom <= 20);
+}
+
+//objects of POV file are written in order in which they are drawn, so --index matches them
+static bool IsIndexedFormat(const char *filename) {
+	return (!HasExtension(filename, ".obj") && !HasExtension(filename, ".glb"));
+}
+
+//cost_model is used only for POV output, render cost isn't estimated when it's NULL
+static SceneWriter *CreateSceneWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom, size_t chunks_per_side, bool chunk_files, const RenderCostModel *cost_model, bool cost_report) {
+	if (HasExtension(filename, ".obj")) return new ObjWriter(filename, view_rect, fix_size_to_square, zoom);
+	else if (HasExtension(filename, ".glb")) return new GltfWriter(filename, view_rect, fix_size_to_square, zoom);
+
+	PovWriter *pov_writer = new PovWriter(filename, view_rect, fix_size_to_square, zoom);
+	if (chunks_per_side > 0) pov_writer->setChunks(chunks_per_side, chunk_files);
+	pov_writer->setCostModel(cost_model, cost_report);
+	return pov_writer;
+}
+
+static void DrawScene(Osm2PovConverter *osm2pov_converter) {
+	//generating objects:
+	
+	//ground level
+	osm2pov_converter->drawAreas("landuse", "farmland", 0.001, "landuse_farmland");
+	osm2pov_converter->drawAreas("landuse", "farm", 0.001, "landuse_farmland");
+	osm2pov_converter->drawAreas("landuse", "farmyard", 0.001, "landuse_farmland");
+	osm2pov_converter->drawForests("landuse", "forest", 0.001, "forest", "tree", 1, 1, 6);
+	osm2pov_converter->drawForests("landuse", "wood", 0.001, "forest", "tree", 1, 1, 6);
+	osm2pov_converter->drawForests("natural", "wood", 0.001, "forest", "tree", 1, 1, 6);
+	
+	osm2pov_converter->drawAreas("landuse", "residential", 0.002, "landuse_residential");
+	osm2pov_converter->drawAreas("landuse", "industrial", 0.002, "landuse_industrial");
+    osm2pov_converter->drawAreas("landuse", "commercial", 0.002, "landuse_industrial");
+    osm2pov_converter->drawAreas("landuse", "retail", 0.002, "landuse_industrial");
+    osm2pov_converter->drawAreas("landuse", "railway", 0.002, "landuse_industrial");
+
+	osm2pov_converter->drawAreas("amenity", "parking", 0.003, "highway_area");
+	osm2pov_converter->drawAreas("landuse", "allotments", 0.003, "greenplace");
+	osm2pov_converter->drawAreas("landuse", "meadow", 0.003, "greenplace");
+	osm2pov_converter->drawAreas("landuse", "greenfield", 0.003, "greenplace");
+    osm2pov_converter->drawAreas("landuse", "vineyard", 0.003, "greenplace");
+	osm2pov_converter->drawAreas("nature", "scrub", 0.003, "greenplace");
+	osm2pov_converter->drawForests("leisure", "park", 0.003, "greenplace", "tree", 1, 1, 6);
+	osm2pov_converter->drawForests("leisure", "garden", 0.003, "greenplace", "tree", 1, 1, 6);
+	osm2pov_converter->drawAreas("natural", "beach", 0.003, "beach");
+
+	osm2pov_converter->drawAreas("landuse", "village_green", 0.004, "greenplace");
+	osm2pov_converter->drawAreas("landuse", "cemetery", 0.004, "cemetery");
+	osm2pov_converter->drawAreas("leisure", "playground", 0.004, "playground");
+	osm2pov_converter->drawAreas("leisure", "pitch", 0.004, "playground");
+	
+	//way level
+	osm2pov_converter->drawWays("waterway", "drain", 1, 0.01, "river", true, true);
+	osm2pov_converter->drawWays("waterway", "stream", 2, 0.01, "river", true, true);
+	osm2pov_converter->drawWays("waterway", "canal", 2.5, 0.01, "river", true, true);
+	osm2pov_converter->drawWays("waterway", "river", 5, 0.01, "river", true, true);
+	osm2pov_converter->drawAreas("waterway", "dock", 0.01, "river");
+	osm2pov_converter->drawAreas("waterway", "riverbank", 0.01, "river");
+	osm2pov_converter->drawAreas("natural", "water", 0.01, "river");
+	osm2pov_converter->drawAreas("landuse", "basin", 0.01, "river");
+	osm2pov_converter->drawAreas("landuse", "reservoir", 0.01, "river");
+	
+	osm2pov_converter->drawWays("highway", "path", 1.2, 0.02, "path", true, false);
+	osm2pov_converter->drawWays("highway", "track", 3, 0.02, "path", true, false);
+	
+	osm2pov_converter->drawWays("highway", "pedestrian", 4, 0.03, "highway", true, true);
+	osm2pov_converter->drawWays("highway", "footway", 2, 0.03, "footway", true, false);
+	osm2pov_converter->drawWays("highway", "steps", 2, 0.03, "footway", true, false);
+	osm2pov_converter->drawWays("highway", "cycleway", 2.5, 0.03, "footway", true, false);
+	
+	osm2pov_converter->drawWays("railway", "preserved", 3, 0.04, "railway", false, false);
+	osm2pov_converter->drawWays("aeroway", "runway", 40, 0.04, "highway", true, true);
+	osm2pov_converter->drawWays("aeroway", "taxiway", 7, 0.04, "highway", true, true);
+	
+	osm2pov_converter->drawWays("highway", "residential", 5, 0.05, "highway", true, true);
+	osm2pov_converter->drawWays("highway", "living_street", 5, 0.05, "highway", true, true);
+	osm2pov_converter->drawWays("highway", "service", 4, 0.05, "highway", true, true);
+	
+	osm2pov_converter->drawWaysWithBorder("highway", "unclassified", 6, 0.06, "highway", 10, "highway_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "road", 6, 0.06, "highway", 10, "highway_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "tertiary", 6.5, 0.06, "highway", 10, "highway_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "secondary", 7, 0.06, "highway", 10, "highway_secondary_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "primary", 8, 0.06, "highway", 10, "highway_secondary_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "primary_link", 5.5, 0.06, "highway", 10, "highway_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "trunk", 7, 0.06, "highway", 10, "highway_secondary_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "trunk_link", 5, 0.06, "highway", 10, "highway_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "motorway", 10, 0.06, "highway", 10, "highway_secondary_border");
+	osm2pov_converter->drawWaysWithBorder("highway", "motorway_link", 5.5, 0.06, "highway", 10, "highway_border");
+	
+	osm2pov_converter->drawWays("railway", "abandoned", 3, 0.07, "railway", false, false);
+	osm2pov_converter->drawWays("railway", "disused", 3, 0.07, "railway", false, false);
+	osm2pov_converter->drawWays("railway", "narrow_gauge", 3, 0.07, "railway", false, false);
+	osm2pov_converter->drawWays("railway", "rail", 5, 0.07, "railway", false, false);
+	
+	osm2pov_converter->drawWays("railway", "tram", 2.25, 0.08, "railway_tram", true, false);
+	
+	//buildings level
+	osm2pov_converter->drawObjects("power_source", "wind", "windpower", 1.5, 1, 1);
+	osm2pov_converter->drawObjects("amenity", "post_box", "postbox", 0.1, 1, 1);
+	osm2pov_converter->drawObjects("natural", "tree", "tree", 0.2, 1, 6);
+	
+	osm2pov_converter->drawBuildings("building", NULL, 4.5, { "building" }, { "building_living_roof1", "building_living_roof2", "building_living_roof3", "building_living_roof4" }, { "building_nonliving_roof1", "building_nonliving_roof2" }, { "building_religious_roof" });
+
+	osm2pov_converter->drawSpecialBuildings("leisure", "stadium", 12, "man_made_tower", "man_made_tower");
+	osm2pov_converter->drawSpecialBuildings("building:part", NULL, 3, "building", "building");
+	osm2pov_converter->drawTowers("artwork_type", "obelisk", 4, 25, "man_made_tower"); //FIXME: for testing only
+	osm2pov_converter->drawTowers("man_made", "tower", 4, 25, "man_made_tower");
+	osm2pov_converter->drawTowers("amenity", "tower", 4, 25, "man_made_tower");
+	osm2pov_converter->drawSpecialBuildings("man_made", "tower", 25, "man_made_tower", "building_nonliving_roof1");
+	osm2pov_converter->drawSpecialBuildings("amenity", "tower", 25, "man_made_tower", "building_nonliving_roof1");
+	osm2pov_converter->drawSpecialBuildings("man_made", "chimney", 50, "man_made_tower", NULL);
+	osm2pov_converter->drawWays("barrier", "wall", 0.3, 3, "wall", true, false);
+}
+
+//returns false when output file cannot be opened or written; geometry of features is computed on task_pool (if it isn't NULL),
+//areas are shared with other tiles by feature_cache (if it isn't NULL) and statistics of draw rules are added to stats
+//(if it isn't NULL); index of objects is written next to output file with write_index and estimated render cost is set
+//to cost (if it isn't NULL)
+static bool WriteScene(PrimitivesView &primitives, TaskPool *task_pool, FeatureCache *feature_cache, Stats *stats, const char *output_filename, bool fix_size_to_square, size_t chunks_per_side, bool chunk_files, const RenderCostModel *cost_model, bool cost_report, bool comments, bool write_index, double *cost) {
+	TraceSpan trace_span("scene", output_filename);
+	SceneWriter *scene_writer = CreateSceneWriter(output_filename, primitives.getViewRect(), fix_size_to_square, primitives.getZoom(), chunks_per_side, chunk_files, cost_model, cost_report);
+	if (!scene_writer->isOpened()) {
+		delete scene_writer;
+		return false;
+	}
+
+	scene_writer->setComments(comments);
+	SceneIndex scene_index;
+	primitives.setTaskPool(task_pool);
+	Osm2PovConverter osm2pov_converter(primitives, *scene_writer, task_pool);
+	osm2pov_converter.setStats(stats);
+	osm2pov_converter.setFeatureCache(feature_cache);
+	if (write_index) osm2pov_converter.setSceneIndex(&scene_index);
+	DrawScene(&osm2pov_converter);
+
+	const size_t objects_count = scene_writer->getObjectsCount();
+	if (cost != NULL) {
+		const PovWriter *pov_writer = dynamic_cast<const PovWriter*>(scene_writer);
+		*cost = (pov_writer != NULL ? pov_writer->getCost() : 0);
+	}
+	const bool written = scene_writer->close();		//writes rest of output
+	delete scene_writer;
+	if (!written) return false;
+	return (!write_index || scene_index.write(output_filename, objects_count));
+}
+
+//adds estimated memory of loaded structures after the phase
+static void AddMemoryUsage(Stats *stats, const Primitives &primitives, const char *phase) {
+	vector<MemoryUsage> structures;
+	primitives.getMemoryUsage(&structures);
+	stats->addMemory(phase, structures);
+}
+
+//statistics are printed even in quiet mode, because they were asked for
+static void PrintStats(const Stats &stats, const char *format) {
+	if (strcmp(format, "json") == 0) stats.printJson(cout);
+	else stats.printTable(cout);
+}
+
+//issues of input data are summed up only at exit, so they aren't written to stderr one by one while drawing
+static bool FinishDiagnostics(const char *report_filename) {
+	if (!g_quiet_mode && g_diagnostics.getCount() > 0) g_diagnostics.printSummary(cerr);
+	return (report_filename == NULL || g_diagnostics.writeReport(report_filename));
+}
+
+//replaces %x and %y in pattern by tile coords
+static string GetTileFilename(const char *pattern, int x, int y) {
+	stringstream filename;
+	for (const char *c = pattern; *c != '\0'; c++) {
+		if (c[0] == '%' && c[1] == 'x') { filename << x; c++; }
+		else if (c[0] == '%' && c[1] == 'y') { filename << y; c++; }
+		else filename << *c;
+	}
+	return filename.str();
+}
+
+//reads pairs "X Y" from file
+static bool ReadTileList(const char *filename, list<pair<int,int> > *tiles) {
+	ifstream fs(filename);
+	if (!fs) {
+		cerr << "Cannot open file " << filename << "!" << endl;
+		return false;
+	}
+	int x, y;
+	while (fs >> x >> y) tiles->push_back(make_pair(x, y));
+	if (!fs.eof()) {
+		cerr << "Bad format of tile list " << filename << "!" << endl;
+		return false;
+	}
+	return true;
+}
+
+//writes tiles in the same format as is read by ReadTileList()
+static bool WriteTileList(const char *filename, const set<pair<int,int> > &tiles) {
+	ofstream fs(filename);
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+	for (set<pair<int,int> >::const_iterator it = tiles.begin(); it != tiles.end(); it++) {
+		fs << it->first << " " << it->second << endl;
+	}
+	return true;
+}
+
 int main(int argc, const char **argv) {
 	int argc_i = 1;
-	if (argc_i >= argc) PrintHelpAndExit();
-	if (strcmp(argv[argc_i], "-q") == 0) {
-		g_quiet_mode = true;
+	size_t chunks_per_side = 0;
+	bool chunk_files = false;
+	size_t threads_count = 0;
+	int zoom = DEFAULT_ZOOM;
+	list<pair<int,int> > tiles;		//when not empty, it's batch mode
+	list<const char*> change_filenames;
+	const char *affected_tiles_filename = NULL;
+	const char *snapshot_filename = NULL;
+	const char *daemon_socket = NULL;
+	const char *node_store_filename = NULL;
+	bool drop_unused = false;
+	const char *stats_format = NULL;
+	const char *trace_filename = NULL;
+	bool cost_report = false;
+	const char *cost_model_filename = NULL;
+	const char *render_command = NULL;
+	size_t render_processes = 1;
+	size_t render_attempts = 3;
+	const char *journal_filename = NULL;
+	bool use_feature_cache = false;
+	bool comments = false;
+	bool write_index = false;
+	const char *diagnostics_filename = NULL;
+	while (argc_i < argc && argv[argc_i][0] == '-') {
+		if (strcmp(argv[argc_i], "-q") == 0) g_quiet_mode = true;
+		else if (strcmp(argv[argc_i], "--chunks") == 0 && argc_i+1 < argc) chunks_per_side = ParsePositiveCount(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--chunk-files") == 0) chunk_files = true;
+		else if (strcmp(argv[argc_i], "--tiles") == 0 && argc_i+4 < argc) {
+			const int min_x = atoi(argv[argc_i+1]), min_y = atoi(argv[argc_i+2]);
+			const int max_x = atoi(argv[argc_i+3]), max_y = atoi(argv[argc_i+4]);
+			for (int y = min_y; y <= max_y; y++) {
+				for (int x = min_x; x <= max_x; x++) tiles.push_back(make_pair(x, y));
+			}
+			argc_i += 4;
+		}
+		else if (strcmp(argv[argc_i], "-j") == 0 && argc_i+1 < argc) threads_count = atoi(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--zoom") == 0 && argc_i+1 < argc) zoom = atoi(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--tile-list") == 0 && argc_i+1 < argc) {
+			if (!ReadTileList(argv[++argc_i], &tiles)) return 1;
+		}
+		else if (strcmp(argv[argc_i], "--update") == 0 && argc_i+1 < argc) change_filenames.push_back(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--affected-tiles") == 0 && argc_i+1 < argc) affected_tiles_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--save-snapshot") == 0 && argc_i+1 < argc) snapshot_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--daemon") == 0 && argc_i+1 < argc) daemon_socket = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--node-store") == 0 && argc_i+1 < argc) node_store_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--drop-unused") == 0) drop_unused = true;
+		else if (strcmp(argv[argc_i], "--stats") == 0 && argc_i+1 < argc) stats_format = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--trace") == 0 && argc_i+1 < argc) trace_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--cost-report") == 0) cost_report = true;
+		else if (strcmp(argv[argc_i], "--cost-model") == 0 && argc_i+1 < argc) cost_model_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--render") == 0 && argc_i+1 < argc) render_command = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--render-jobs") == 0 && argc_i+1 < argc) render_processes = atoi(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--render-attempts") == 0 && argc_i+1 < argc) render_attempts = atoi(argv[++argc_i]);
+		else if (strcmp(argv[argc_i], "--journal") == 0 && argc_i+1 < argc) journal_filename = argv[++argc_i];
+		else if (strcmp(argv[argc_i], "--feature-cache") == 0) use_feature_cache = true;
+		else if (strcmp(argv[argc_i], "--comments") == 0) comments = true;
+		else if (strcmp(argv[argc_i], "--index") == 0) write_index = true;
+		else if (strcmp(argv[argc_i], "--diagnostics") == 0 && argc_i+1 < argc) diagnostics_filename = argv[++argc_i];
+		else PrintHelpAndExit();
 		argc_i++;
-		if (argc_i >= argc) PrintHelpAndExit();
 	}
-	const char *input_filename = argv[argc_i++];
 	if (argc_i >= argc) PrintHelpAndExit();
-	const char *output_filename = argv[argc_i++];
+	if (stats_format != NULL && strcmp(stats_format, "table") != 0 && strcmp(stats_format, "json") != 0) PrintHelpAndExit();
+	if (!IsZoomValid(zoom)) {
+		cerr << "Zoom must be from 1 to 20." << endl;
+		return 1;
+	}
+	const char *input_filename = argv[argc_i++];
+	const char *output_filename = NULL;		//it's optional when snapshot is only updated or tiles are served by daemon
+	if (daemon_socket != NULL) {
+		if (argc_i != argc || !tiles.empty()) PrintHelpAndExit();
+		if (chunk_files || stats_format != NULL || trace_filename != NULL || diagnostics_filename != NULL) {
+			cerr << "Chunk files, statistics, trace and diagnostics can't be used in daemon mode." << endl;
+			return 1;
+		}
+	}
+	else if (argc_i < argc) output_filename = argv[argc_i++];
+	else if (snapshot_filename == NULL && change_filenames.empty()) PrintHelpAndExit();
+	if (write_index && (chunks_per_side > 0 || (output_filename != NULL && !IsIndexedFormat(output_filename)))) {
+		cerr << "Index can't be written with chunks or to OBJ and glTF files (objects are regrouped there)." << endl;
+		return 1;
+	}
+
+	RenderCostModel cost_model_weights;
+	if (cost_model_filename != NULL && !cost_model_weights.loadFromFile(cost_model_filename)) return 1;
+	if (cost_model_filename != NULL) cost_report = true;
+	const RenderCostModel *cost_model = (cost_report || render_command != NULL ? &cost_model_weights : NULL);		//renders are ordered by cost
 
 	Primitives primitives;
 	bool fix_size_to_square = true;
@@ -48,12 +388,40 @@ int main(int argc, const char **argv) {
 		const int x = atoi(argv[argc_i++]);
 		const int y = atoi(argv[argc_i++]);
 
-		primitives.setBoundsByXY(x, y);
+		primitives.setBoundsByXY(x, y, zoom);
 		fix_size_to_square = false;
 	}
 	else if (argc_i != argc)
 		PrintHelpAndExit();
 
+	if (!tiles.empty() && output_filename != NULL) {
+		if (!fix_size_to_square) PrintHelpAndExit();		//X and Y can't be used together with tiles
+		if (strstr(output_filename, "%x") == NULL || strstr(output_filename, "%y") == NULL) {
+			cerr << "Output file name must contain %x and %y when more tiles are written." << endl;
+			return 1;
+		}
+	}
+	else if (render_command != NULL || journal_filename != NULL || use_feature_cache) {
+		cerr << "Rendering, journal and feature cache can be used only when more tiles are written to files (--tiles or --tile-list)." << endl;
+		return 1;
+	}
+
+	TileJournal journal;		//tiles done in interrupted run are skipped
+	if (journal_filename != NULL) {
+		if (!journal.open(journal_filename)) return 1;
+		for (list<pair<int,int> >::iterator it = tiles.begin(); it != tiles.end(); ) {
+			if (journal.isDone(it->first, it->second)) it = tiles.erase(it);
+			else it++;
+		}
+		if (tiles.empty()) {
+			if (!g_quiet_mode) cout << "All tiles are done." << endl;
+			return 0;
+		}
+	}
+	if (!tiles.empty() && output_filename != NULL) {
+		primitives.setBoundsByXY(tiles.front().first, tiles.front().second, zoom);		//bounds in input file are ignored
+	}
+
 
 	if (!g_quiet_mode) cout << "Loading input file" << endl;
 
@@ -116,107 +484,180 @@ int main(int argc, const char **argv) {
 	primitives.setLightlyIgnoredAttribute("type", "multipolygon");
 	primitives.setLightlyIgnoredAttribute("wood", NULL);
 
+	Trace trace;		//it's closed when main() ends, after all threads
+	if (trace_filename != NULL) {
+		if (!trace.open(trace_filename)) return 1;
+		g_trace = &trace;
+	}
+	Stats stats;
+	StopWatch load_stop_watch;
+
 	//loading from file
-	if (!primitives.loadFromXml(input_filename)) return 1;
+	if (node_store_filename != NULL) {
+		if (Primitives::isSnapshotFile(input_filename) || snapshot_filename != NULL || !change_filenames.empty()) {
+			cerr << "Node store can't be used with snapshots and updates." << endl;
+			return 1;
+		}
+		if (!primitives.useNodeStore(node_store_filename)) return 1;
+	}
+	if (Primitives::isSnapshotFile(input_filename)) {
+		if (!primitives.loadFromSnapshot(input_filename)) return 1;
+	}
+	else if (!primitives.loadFromXml(input_filename)) return 1;
+	stats.addPhase("load", load_stop_watch.getSeconds());
+	if (stats_format != NULL) AddMemoryUsage(&stats, primitives, "load");		//it goes through all data, so only when it's printed
 
-	if (!g_quiet_mode) cout << "Writing POV file" << endl;
-	PovWriter pov_writer(output_filename, primitives.getViewRect(), fix_size_to_square);
-	if (!pov_writer.isOpened()) return 1;
+	if (!change_filenames.empty()) {
+		StopWatch stop_watch;
+		set<pair<int,int> > affected_tiles;
+		for (list<const char*>::const_iterator it = change_filenames.begin(); it != change_filenames.end(); it++) {
+			if (!g_quiet_mode) cout << "Applying changes from " << *it << endl;
+			if (!primitives.applyChangeFromXml(*it, &affected_tiles)) return 1;
+		}
+		if (affected_tiles_filename != NULL && !WriteTileList(affected_tiles_filename, affected_tiles)) return 1;
+		stats.addPhase("update", stop_watch.getSeconds());
+		if (stats_format != NULL) AddMemoryUsage(&stats, primitives, "update");
+	}
 
-	Osm2PovConverter osm2pov_converter(primitives, pov_writer);
+	if (snapshot_filename != NULL) {
+		StopWatch stop_watch;
+		if (!g_quiet_mode) cout << "Saving snapshot" << endl;
+		if (!primitives.saveSnapshot(snapshot_filename)) return 1;
+		stats.addPhase("save_snapshot", stop_watch.getSeconds());
+	}
 
-	//generating objects:
-	
-	//ground level
-	osm2pov_converter.drawAreas("landuse", "farmland", 0.001, "landuse_farmland");
-	osm2pov_converter.drawAreas("landuse", "farm", 0.001, "landuse_farmland");
-	osm2pov_converter.drawAreas("landuse", "farmyard", 0.001, "landuse_farmland");
-	osm2pov_converter.drawForests("landuse", "forest", 0.001, "forest", "tree", 1, 1, 6);
-	osm2pov_converter.drawForests("landuse", "wood", 0.001, "forest", "tree", 1, 1, 6);
-	osm2pov_converter.drawForests("natural", "wood", 0.001, "forest", "tree", 1, 1, 6);
-	
-	osm2pov_converter.drawAreas("landuse", "residential", 0.002, "landuse_residential");
-	osm2pov_converter.drawAreas("landuse", "industrial", 0.002, "landuse_industrial");
-    osm2pov_converter.drawAreas("landuse", "commercial", 0.002, "landuse_industrial");
-    osm2pov_converter.drawAreas("landuse", "retail", 0.002, "landuse_industrial");
-    osm2pov_converter.drawAreas("landuse", "railway", 0.002, "landuse_industrial");
-
-	osm2pov_converter.drawAreas("amenity", "parking", 0.003, "highway_area");
-	osm2pov_converter.drawAreas("landuse", "allotments", 0.003, "greenplace");
-	osm2pov_converter.drawAreas("landuse", "meadow", 0.003, "greenplace");
-	osm2pov_converter.drawAreas("landuse", "greenfield", 0.003, "greenplace");
-    osm2pov_converter.drawAreas("landuse", "vineyard", 0.003, "greenplace");
-	osm2pov_converter.drawAreas("nature", "scrub", 0.003, "greenplace");
-	osm2pov_converter.drawForests("leisure", "park", 0.003, "greenplace", "tree", 1, 1, 6);
-	osm2pov_converter.drawForests("leisure", "garden", 0.003, "greenplace", "tree", 1, 1, 6);
-	osm2pov_converter.drawAreas("natural", "beach", 0.003, "beach");
-
-	osm2pov_converter.drawAreas("landuse", "village_green", 0.004, "greenplace");
-	osm2pov_converter.drawAreas("landuse", "cemetery", 0.004, "cemetery");
-	osm2pov_converter.drawAreas("leisure", "playground", 0.004, "playground");
-	osm2pov_converter.drawAreas("leisure", "pitch", 0.004, "playground");
-	
-	//way level
-	osm2pov_converter.drawWays("waterway", "drain", 1, 0.01, "river", true, true);
-	osm2pov_converter.drawWays("waterway", "stream", 2, 0.01, "river", true, true);
-	osm2pov_converter.drawWays("waterway", "canal", 2.5, 0.01, "river", true, true);
-	osm2pov_converter.drawWays("waterway", "river", 5, 0.01, "river", true, true);
-	osm2pov_converter.drawAreas("waterway", "dock", 0.01, "river");
-	osm2pov_converter.drawAreas("waterway", "riverbank", 0.01, "river");
-	osm2pov_converter.drawAreas("natural", "water", 0.01, "river");
-	osm2pov_converter.drawAreas("landuse", "basin", 0.01, "river");
-	osm2pov_converter.drawAreas("landuse", "reservoir", 0.01, "river");
-	
-	osm2pov_converter.drawWays("highway", "path", 1.2, 0.02, "path", true, false);
-	osm2pov_converter.drawWays("highway", "track", 3, 0.02, "path", true, false);
-	
-	osm2pov_converter.drawWays("highway", "pedestrian", 4, 0.03, "highway", true, true);
-	osm2pov_converter.drawWays("highway", "footway", 2, 0.03, "footway", true, false);
-	osm2pov_converter.drawWays("highway", "steps", 2, 0.03, "footway", true, false);
-	osm2pov_converter.drawWays("highway", "cycleway", 2.5, 0.03, "footway", true, false);
-	
-	osm2pov_converter.drawWays("railway", "preserved", 3, 0.04, "railway", false, false);
-	osm2pov_converter.drawWays("aeroway", "runway", 40, 0.04, "highway", true, true);
-	osm2pov_converter.drawWays("aeroway", "taxiway", 7, 0.04, "highway", true, true);
-	
-	osm2pov_converter.drawWays("highway", "residential", 5, 0.05, "highway", true, true);
-	osm2pov_converter.drawWays("highway", "living_street", 5, 0.05, "highway", true, true);
-	osm2pov_converter.drawWays("highway", "service", 4, 0.05, "highway", true, true);
-	
-	osm2pov_converter.drawWaysWithBorder("highway", "unclassified", 6, 0.06, "highway", 10, "highway_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "road", 6, 0.06, "highway", 10, "highway_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "tertiary", 6.5, 0.06, "highway", 10, "highway_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "secondary", 7, 0.06, "highway", 10, "highway_secondary_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "primary", 8, 0.06, "highway", 10, "highway_secondary_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "primary_link", 5.5, 0.06, "highway", 10, "highway_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "trunk", 7, 0.06, "highway", 10, "highway_secondary_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "trunk_link", 5, 0.06, "highway", 10, "highway_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "motorway", 10, 0.06, "highway", 10, "highway_secondary_border");
-	osm2pov_converter.drawWaysWithBorder("highway", "motorway_link", 5.5, 0.06, "highway", 10, "highway_border");
-	
-	osm2pov_converter.drawWays("railway", "abandoned", 3, 0.07, "railway", false, false);
-	osm2pov_converter.drawWays("railway", "disused", 3, 0.07, "railway", false, false);
-	osm2pov_converter.drawWays("railway", "narrow_gauge", 3, 0.07, "railway", false, false);
-	osm2pov_converter.drawWays("railway", "rail", 5, 0.07, "railway", false, false);
-	
-	osm2pov_converter.drawWays("railway", "tram", 2.25, 0.08, "railway_tram", true, false);
-	
-	//buildings level
-	osm2pov_converter.drawObjects("power_source", "wind", "windpower", 1.5, 1, 1);
-	osm2pov_converter.drawObjects("amenity", "post_box", "postbox", 0.1, 1, 1);
-	osm2pov_converter.drawObjects("natural", "tree", "tree", 0.2, 1, 6);
-	
-	osm2pov_converter.drawBuildings("building", NULL, 4.5, { "building" }, { "building_living_roof1", "building_living_roof2", "building_living_roof3", "building_living_roof4" }, { "building_nonliving_roof1", "building_nonliving_roof2" }, { "building_religious_roof" });
-
-	osm2pov_converter.drawSpecialBuildings("leisure", "stadium", 12, "man_made_tower", "man_made_tower");
-	osm2pov_converter.drawSpecialBuildings("building:part", NULL, 3, "building", "building");
-	osm2pov_converter.drawTowers("artwork_type", "obelisk", 4, 25, "man_made_tower"); //FIXME: for testing only
-	osm2pov_converter.drawTowers("man_made", "tower", 4, 25, "man_made_tower");
-	osm2pov_converter.drawTowers("amenity", "tower", 4, 25, "man_made_tower");
-	osm2pov_converter.drawSpecialBuildings("man_made", "tower", 25, "man_made_tower", "building_nonliving_roof1");
-	osm2pov_converter.drawSpecialBuildings("amenity", "tower", 25, "man_made_tower", "building_nonliving_roof1");
-	osm2pov_converter.drawSpecialBuildings("man_made", "chimney", 50, "man_made_tower", NULL);
-	osm2pov_converter.drawWays("barrier", "wall", 0.3, 3, "wall", true, false);
-	
+	if (drop_unused) {
+		StopWatch stop_watch;
+		if (snapshot_filename != NULL || !change_filenames.empty()) {
+			cerr << "Unused data can't be dropped with snapshots and updates." << endl;
+			return 1;
+		}
+		//in batch mode only objects in interest rectangles of written tiles are drawn, otherwise everything can be drawn
+		if (!tiles.empty() && daemon_socket == NULL) {
+			Rect keep_rect = Primitives::getTileRect(tiles.front().first, tiles.front().second, zoom);
+			for (list<pair<int,int> >::const_iterator it = tiles.begin(); it != tiles.end(); it++) {
+				const Rect tile_rect = Primitives::getTileRect(it->first, it->second, zoom);
+				keep_rect.minlat = min(keep_rect.minlat, tile_rect.minlat);
+				keep_rect.minlon = min(keep_rect.minlon, tile_rect.minlon);
+				keep_rect.maxlat = max(keep_rect.maxlat, tile_rect.maxlat);
+				keep_rect.maxlon = max(keep_rect.maxlon, tile_rect.maxlon);
+			}
+			keep_rect.enlargeByPercent(5);
+			primitives.dropUnusedPrimitives(&keep_rect);
+		}
+		else primitives.dropUnusedPrimitives(NULL);
+		stats.addPhase("drop_unused", stop_watch.getSeconds());
+		if (stats_format != NULL) AddMemoryUsage(&stats, primitives, "drop_unused");
+	}
+
+	if (daemon_socket != NULL) {
+		//like batch mode, but tiles are written when they are requested
+		mutex results_lock;
+		TaskPool pool(threads_count);
+		RenderServer server([&](int x, int y, int zoom, const char *filename, string *error) {
+			if (!IsZoomValid(zoom)) {
+				*error = "Zoom must be from 1 to 20";
+				return false;
+			}
+			if (write_index && !IsIndexedFormat(filename)) {
+				*error = "Index can't be written to OBJ and glTF files";
+				return false;
+			}
+			if (primitives.usesNodeStore()) primitives.waitForStoredNodesLimit(NODE_STORE_DAEMON_NODES);
+			PrimitivesView primitives_view(primitives);
+			primitives_view.setBoundsByXY(x, y, zoom);
+			primitives_view.setOnlyObjectsInInterestRect(true);
+			if (!WriteScene(primitives_view, &pool, NULL, NULL, filename, false, chunks_per_side, false, cost_model, cost_report, comments, write_index, NULL)) {
+				*error = string("Cannot write ") + filename;
+				return false;
+			}
+			if (!g_quiet_mode) {
+				stringstream s;
+				s << "Written tile " << x << " " << y << " to " << filename << endl;
+				cout << s.str() << flush;
+			}
+
+			lock_guard<mutex> guard(results_lock);
+			primitives.setAttributesUsed(primitives_view.getUsedAttributes());
+			return true;
+		}, threads_count);
+		if (!server.listen(daemon_socket)) return 1;
+		if (!g_quiet_mode) cout << "Listening on " << daemon_socket << endl;
+		server.run();
+		return 1;		//daemon stops only when it cannot accept connections
+	}
+
+	if (output_filename == NULL) {
+		if (stats_format != NULL) PrintStats(stats, stats_format);
+		if (!FinishDiagnostics(diagnostics_filename)) return 1;
+		if (!g_quiet_mode) cout << "Done." << endl;
+		return 0;
+	}
+
+	StopWatch write_stop_watch;
+	bool success = true;
+	RenderJobRunner render_jobs(render_command != NULL ? render_command : "", render_processes, render_attempts, journal_filename != NULL ? &journal : NULL);
+	if (tiles.empty()) {
+		if (!g_quiet_mode) cout << "Writing output file" << endl;
+		TaskPool pool(threads_count);
+		PrimitivesView primitives_view(primitives);
+		primitives_view.setOnlyObjectsInInterestRect(!fix_size_to_square);		//one tile is drawn the same as in batch mode
+		if (!WriteScene(primitives_view, &pool, NULL, stats_format != NULL ? &stats : NULL, output_filename, fix_size_to_square, chunks_per_side, chunk_files, cost_model, cost_report, comments, write_index, NULL)) success = false;
+		primitives.setAttributesUsed(primitives_view.getUsedAttributes());
+	}
+	else {
+		//every tile uses the same loaded data (read only), only with other view and interest rectangle
+		FeatureCache feature_cache;		//used only with --feature-cache
+		TaskPool pool(threads_count);
+		mutex results_lock;
+		size_t submitted_count = 0;
+		for (list<pair<int,int> >::const_iterator it = tiles.begin(); it != tiles.end(); it++) {
+			const int x = it->first, y = it->second;
+			if (primitives.usesNodeStore() && submitted_count > 0 && submitted_count % (pool.getThreadsCount() * NODE_STORE_TILES_PER_THREAD) == 0) {
+				pool.wait();		//views of written tiles end, so nodes created from node store are released
+			}
+			submitted_count++;
+			pool.submit([&, x, y]() {
+				const string tile_filename = GetTileFilename(output_filename, x, y);
+				if (!g_quiet_mode) {
+					stringstream s;
+					s << "Writing tile " << x << " " << y << " to " << tile_filename << endl;
+					cout << s.str();
+				}
+				PrimitivesView primitives_view(primitives);
+				primitives_view.setBoundsByXY(x, y, zoom);
+				primitives_view.setOnlyObjectsInInterestRect(true);
+				Stats tile_stats;
+				double cost = 0;
+				bool tile_success = WriteScene(primitives_view, &pool, use_feature_cache ? &feature_cache : NULL, stats_format != NULL ? &tile_stats : NULL, tile_filename.c_str(), false, chunks_per_side, chunk_files, cost_model, cost_report, comments, write_index, &cost);
+				if (tile_success && render_command != NULL) render_jobs.addJob(x, y, tile_filename, cost);		//tile is done when it's rendered
+				else if (tile_success && journal_filename != NULL) tile_success = journal.markDone(x, y);
+
+				lock_guard<mutex> guard(results_lock);
+				if (!tile_success) success = false;
+				primitives.setAttributesUsed(primitives_view.getUsedAttributes());
+				stats.merge(tile_stats);
+			});
+		}
+		pool.wait();
+		if (use_feature_cache && !g_quiet_mode) {
+			cout << "Feature cache: " << feature_cache.getAreasCount() << " areas assembled, " << feature_cache.getReusedCount() << " times reused" << endl;
+		}
+	}
+	stats.addPhase("write", write_stop_watch.getSeconds());
+
+	if (render_command != NULL) {
+		StopWatch stop_watch;
+		if (!render_jobs.run()) success = false;
+		stats.addPhase("render", stop_watch.getSeconds());
+	}
+	//summary, statistics and trace are written also after failure
+	if (!FinishDiagnostics(diagnostics_filename)) success = false;
+	if (stats_format != NULL) PrintStats(stats, stats_format);
+	if (g_trace != NULL && !trace.close()) {
+		cerr << "Cannot write " << trace_filename << "!" << endl;
+		success = false;
+	}
+	if (!success) return 1;
 	if (!g_quiet_mode) cout << "Done." << endl;
 }
@@ -3,9 +3,17 @@
 #include "point_field.h"
 #include "output_polygon.h"
 #include "osm2pov_converter.h"
-#include "pov_writer.h"
+#include "diagnostics.h"
+#include "feature_cache.h"
+#include "scene_writer.h"
 #include "primitives.h"
+#include "random_generator.h"
+#include "scene_index.h"
+#include "stats.h"
+#include "task_pool.h"
+#include "trace.h"
 
+#define MIN_SMALL_OBJECTS_ZOOM 11
 
 
 /*
@@ -96,20 +104,74 @@ Osm2PovConverter::BuildingType Osm2PovConverter::getBuildingType(const MultiPoly
 	else return BuildingType::living_building;
 }
 
+//Adds time and counters of one call of draw function to stats (if they're collected). Rule is named by kind of
+//drawing, tag and style, e.g. "ways highway=footway footway".
+class Osm2PovConverter::RuleScope {
+	private:
+	Osm2PovConverter &converter;
+	string name;
+	StopWatch stop_watch;
+	size_t scanned_count, matched_count;
+	SceneCounters counters;
+
+	public:
+	RuleScope(Osm2PovConverter &converter, const char *kind, const char *key, const char *value, const char *style) : converter(converter) {
+		if (converter.stats == NULL && g_trace == NULL && converter.scene_index == NULL) return;
+		this->name = string(kind) + " " + key + "=" + (value == NULL ? "*" : value);
+		if (style != NULL) this->name += string(" ") + style;
+		converter.rule_name = &this->name;
+		this->scanned_count = converter.primitives.getScannedCount();
+		this->matched_count = converter.primitives.getMatchedCount();
+		this->counters = converter.scene_writer.getCounters();
+	}
+	~RuleScope() {
+		this->converter.rule_name = NULL;
+		if (g_trace != NULL) g_trace->addSpan("rule", this->name, this->stop_watch.getStart(), chrono::steady_clock::now(), 0);
+		if (this->converter.stats == NULL) return;
+		SceneCounters written = this->converter.scene_writer.getCounters();
+		written.triangles -= this->counters.triangles;
+		written.polygons -= this->counters.polygons;
+		written.boxes -= this->counters.boxes;
+		written.cylinders -= this->counters.cylinders;
+		written.sprites -= this->counters.sprites;
+		written.bytes -= this->counters.bytes;
+		this->converter.stats->addRule(this->name, this->stop_watch.getSeconds(), this->converter.primitives.getScannedCount() - this->scanned_count,
+		 this->converter.primitives.getMatchedCount() - this->matched_count, written);
+	}
+};
+
+//Objects written after it (until the next feature) are drawn from OSM primitive(s) with given id(s)
+void Osm2PovConverter::addFeatureToIndex(uint64_t id) {
+	if (this->scene_index == NULL) return;
+	this->scene_index->beginFeature(this->scene_writer.getObjectsCount(), vector<uint64_t>(1, id), *this->rule_name);
+}
+
+void Osm2PovConverter::addFeatureToIndex(const list<uint64_t> &ids) {
+	if (this->scene_index == NULL) return;
+	this->scene_index->beginFeature(this->scene_writer.getObjectsCount(), vector<uint64_t>(ids.begin(), ids.end()), *this->rule_name);
+}
+
+//trees and other sprites are smaller than pixel in low zooms and there would be too many of them in one tile
+bool Osm2PovConverter::drawsSmallObjects() const {
+	return (this->scene_writer.getZoom() >= MIN_SMALL_OBJECTS_ZOOM);
+}
+
 void Osm2PovConverter::drawTowers(const char *key, const char *value, double width, double default_height, const char *style) {
+	RuleScope rule_scope(*this, "towers", key, value, style);
 	list<const Node*> nodes;
 	this->primitives.getNodesWithAttribute(&nodes, key, value);
 	for (list<const Node*>::iterator it = nodes.begin(); it != nodes.end(); it++) {
-		{
+		this->addFeatureToIndex((*it)->getId());
+		if (this->scene_writer.writesComments()) {
 			stringstream s;
 			s << "Node " << (*it)->getId() << " (tag " << key;
 			if (value != NULL) s << "=" << value;
 			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->scene_writer.writeComment(s.str().c_str());
 		}
 
-		double x = this->pov_writer.convertLonToCoord((*it)->getLon());
-		double y = this->pov_writer.convertLatToCoord((*it)->getLat());
+		double x = this->scene_writer.convertLonToCoord((*it)->getLon());
+		double y = this->scene_writer.convertLatToCoord((*it)->getLat());
 
 		this->point_field.addPoint((*it)->getLon(), (*it)->getLat(), metres2unit(width+1.5)*2);
 
@@ -117,48 +179,118 @@ void Osm2PovConverter::drawTowers(const char *key, const char *value, double wid
 		const char *str = (*it)->getAttribute("height");
 		if (str != NULL) height = readDimension(str);
 
-		this->pov_writer.writeCylinder(x, y, metres2unit(width)/2, metres2unit(height), style);
+		this->scene_writer.writeCylinder(x, y, this->scene_writer.convertMetresToCoord(width)/2, this->scene_writer.convertMetresToCoord(height), style);
 	}
 }
 
+//Line is drawn as one ribbon mesh, so joins between segments don't need any extra objects. Links (cylinders) are
+//only at ends of line, to be round and to join it with other lines.
 void Osm2PovConverter::drawWay(const vector<const Node*> &nodes, double width, double height, const char *style, bool including_links, bool links_also_in_margin) {
-	double x_before, y_before;
+	vector<XY> points;
 	double lon_before, lat_before;
 	for (size_t i = 0; i < nodes.size(); i++) {
 		const Node *node = nodes[i];
-		double x = this->pov_writer.convertLonToCoord(node->getLon());
-		double y = this->pov_writer.convertLatToCoord(node->getLat());
-
 		if (i == 0) {
 			this->point_field.addPoint(node->getLon(), node->getLat(), metres2unit(width+1.5)*2);
 		}
 		else {
 			this->point_field.addPointsInDistance(lon_before, lat_before, node->getLon(), node->getLat(), metres2unit(width+1.5)*2);
-			double x_delta = x-x_before, y_delta = y-y_before;
-			double angle = (-(atan2(y_delta,x_delta) * 180 / M_PI)) + 180;
-			double length = sqrt(x_delta*x_delta+y_delta*y_delta);
-
-			this->pov_writer.writeBox(x, y, metres2unit(width), metres2unit(height), length, angle, style);
 		}
+		points.push_back(XY(this->scene_writer.convertLonToCoord(node->getLon()), this->scene_writer.convertLatToCoord(node->getLat())));
+
+		lon_before = node->getLon(); lat_before = node->getLat();
+	}
+	if (points.empty()) return;
 
-		if (including_links) {
-			if (links_also_in_margin || (i > 0 && i < nodes.size()-1))
-				this->pov_writer.writeCylinder(x, y, metres2unit(width)/2, metres2unit(height), style);
+	Mesh mesh;
+	AddRibbonToMesh(points, this->scene_writer.convertMetresToCoord(width), this->scene_writer.convertMetresToCoord(height), style, &mesh);
+	this->scene_writer.writeMesh(mesh);
+
+	const bool is_closed = (nodes.size() > 1 && nodes.front()->getId() == nodes.back()->getId());
+	if (including_links && links_also_in_margin && !is_closed) {
+		this->scene_writer.writeCylinder(points.front().x, points.front().y, this->scene_writer.convertMetresToCoord(width)/2, this->scene_writer.convertMetresToCoord(height), style);
+		if (points.size() > 1)
+			this->scene_writer.writeCylinder(points.back().x, points.back().y, this->scene_writer.convertMetresToCoord(width)/2, this->scene_writer.convertMetresToCoord(height), style);
+	}
+}
+
+struct WayLine {		//continuous line joined from ways
+	vector<const Node*> nodes;
+	list<uint64_t> way_ids;
+};
+
+//Joins ways which are connected by their ends to lines. Ways are joined only where exactly two of them meet,
+//so crossings stay ends of lines.
+static void JoinWaysToLines(const list<const Way*> &ways, list<WayLine> *lines) {
+	const vector<const Way*> ways_vector(ways.begin(), ways.end());
+	map<uint64_t,vector<size_t> > ways_by_end_node;
+	for (size_t i = 0; i < ways_vector.size(); i++) {
+		if (ways_vector[i]->getNodes().empty()) continue;
+		ways_by_end_node[ways_vector[i]->getFirstNodeId()].push_back(i);
+		if (ways_vector[i]->getLastNodeId() != ways_vector[i]->getFirstNodeId())
+			ways_by_end_node[ways_vector[i]->getLastNodeId()].push_back(i);
+	}
+
+	vector<bool> used(ways_vector.size(), false);
+	for (size_t i = 0; i < ways_vector.size(); i++) {
+		if (used[i]) continue;
+		used[i] = true;
+		lines->push_back(WayLine());
+		WayLine &line = lines->back();
+		line.nodes = ways_vector[i]->getNodes();
+		line.way_ids.push_back(ways_vector[i]->getId());
+		if (line.nodes.empty()) continue;
+
+		for (size_t at_end = 0; at_end < 2; at_end++) {		//extend line at its start, then at its end
+			while (line.nodes.front()->getId() != line.nodes.back()->getId()) {
+				const uint64_t node_id = (at_end ? line.nodes.back() : line.nodes.front())->getId();
+				const vector<size_t> &candidates = ways_by_end_node[node_id];
+				if (candidates.size() != 2) break;
+				const size_t next = (used[candidates[0]] ? candidates[1] : candidates[0]);
+				if (used[next]) break;
+				used[next] = true;
+
+				vector<const Node*> next_nodes = ways_vector[next]->getNodes();
+				if (at_end) {
+					if (next_nodes.front()->getId() != node_id) reverse(next_nodes.begin(), next_nodes.end());
+					line.nodes.insert(line.nodes.end(), next_nodes.begin()+1, next_nodes.end());
+					line.way_ids.push_back(ways_vector[next]->getId());
+				}
+				else {
+					if (next_nodes.back()->getId() != node_id) reverse(next_nodes.begin(), next_nodes.end());
+					line.nodes.insert(line.nodes.begin(), next_nodes.begin(), next_nodes.end()-1);
+					line.way_ids.push_front(ways_vector[next]->getId());
+				}
+			}
 		}
+	}
+}
 
-		x_before = x; y_before = y;
-		lon_before = node->getLon(); lat_before = node->getLat();
+static string GetWayLineComment(const WayLine &line, const char *description, const char *key, const char *value, double width) {
+	stringstream s;
+	s << (line.way_ids.size() == 1 ? "Way " : "Ways ");
+	for (list<uint64_t>::const_iterator it = line.way_ids.begin(); it != line.way_ids.end(); it++) {
+		s << (it == line.way_ids.begin() ? "" : ", ") << *it;
 	}
+	s << description << " (tag " << key;
+	if (value != NULL) s << "=" << value;
+	s << ", width: " << width << "m" << ")";
+	return s.str();
 }
 
 void Osm2PovConverter::drawWays(const char *key, const char *value, double width, double height, const char *style, bool including_links, bool area_possible) {
+	RuleScope rule_scope(*this, "ways", key, value, style);
 	list<const Way*> ways;
 	this->primitives.getWaysWithAttribute(&ways, key, value);
+	map<WayGroupKey,list<const Way*> > groups;
 	for (list<const Way*>::iterator it = ways.begin(); it != ways.end(); it++) {
 		if (area_possible && (*it)->hasAttribute("area", "yes")) {
-			stringstream s;
-			s << "Area (closed way with area=yes) " << (*it)->getId();
-			this->pov_writer.writeComment(s.str().c_str());
+			this->addFeatureToIndex((*it)->getId());
+			if (this->scene_writer.writesComments()) {
+				stringstream s;
+				s << "Area (closed way with area=yes) " << (*it)->getId();
+				this->scene_writer.writeComment(s.str().c_str());
+			}
 
 			this->drawArea((*it)->getId(), (*it)->getNodes(), height+0.0001, strcmp(style,"highway") == 0 ? "highway_area" : style);
 			continue;
@@ -166,32 +298,37 @@ void Osm2PovConverter::drawWays(const char *key, const char *value, double width
 		const char *extra_layer_str = (*it)->getAttribute("layer");
 		double extra_layer = (extra_layer_str == NULL ? 0 : atof(extra_layer_str)/500);
 		if (extra_layer < 0) continue; //skip objects under the ground
-		
-		double real_width = computeWayWidth(**it, width);
-
-		{
-			stringstream s;
-			s << "Way " << (*it)->getId() << " (tag " << key;
-			if (value != NULL) s << "=" << value;
-			s << ", width: " << real_width << "m" << ")";
-			this->pov_writer.writeComment(s.str().c_str());
-		}
 
+		const WayGroupKey group_key = { computeWayWidth(**it, width), height+extra_layer, true, false };
+		groups[group_key].push_back(*it);
+	}
 
-		this->drawWay((*it)->getNodes(), real_width, height+extra_layer, style, including_links, true);
+	for (map<WayGroupKey,list<const Way*> >::const_iterator it = groups.begin(); it != groups.end(); it++) {
+		list<WayLine> lines;
+		JoinWaysToLines(it->second, &lines);
+		for (list<WayLine>::const_iterator it2 = lines.begin(); it2 != lines.end(); it2++) {
+			this->addFeatureToIndex(it2->way_ids);
+			if (this->scene_writer.writesComments()) this->scene_writer.writeComment(GetWayLineComment(*it2, "", key, value, it->first.width).c_str());
+			this->drawWay(it2->nodes, it->first.width, it->first.height, style, including_links, it->first.links_also_in_margin);
+		}
 	}
 }
 
 void Osm2PovConverter::drawWaysWithBorder(const char *key, const char *value, double width, double height, const char *style, double border_width_percent, const char *border_style) {
+	RuleScope rule_scope(*this, "ways_with_border", key, value, style);
 	list<const Way*> ways;
 	this->primitives.getWaysWithAttribute(&ways, key, value);
+	map<WayGroupKey,list<const Way*> > groups;
 	for (list<const Way*>::iterator it = ways.begin(); it != ways.end(); it++) {
 		if ((*it)->hasAttribute("area", "yes")) {
-			stringstream s;
-			s << "Area (closed way with area=yes) " << (*it)->getId() << " (tag " << key;
-			if (value != NULL) s << "=" << value;
-			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->addFeatureToIndex((*it)->getId());
+			if (this->scene_writer.writesComments()) {
+				stringstream s;
+				s << "Area (closed way with area=yes) " << (*it)->getId() << " (tag " << key;
+				if (value != NULL) s << "=" << value;
+				s << ")";
+				this->scene_writer.writeComment(s.str().c_str());
+			}
 
 			drawArea((*it)->getId(), (*it)->getNodes(), height+0.0001, strcmp(style,"highway") == 0 ? "highway_area" : style);
 			continue;
@@ -200,19 +337,21 @@ void Osm2PovConverter::drawWaysWithBorder(const char *key, const char *value, do
 		const char *extra_layer_str = (*it)->getAttribute("layer");
 		double extra_layer = (extra_layer_str == NULL ? 0 : atof(extra_layer_str)/500);
 		if (extra_layer < 0 && !is_tunnel) continue; //skip objects under the ground
-		if (is_tunnel) height /= 2;	//!
-		
-		double real_width = computeWayWidth(**it, width);
 
-		{
-			stringstream s;
-			s << "Way " << (*it)->getId() << " with border (tag " << key;
-			if (value != NULL) s << "=" << value;
-			s << ", width: " << real_width << "m" << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+		const WayGroupKey group_key = { computeWayWidth(**it, width), (is_tunnel ? height/2 : height)+extra_layer, extra_layer == 0, is_tunnel };
+		groups[group_key].push_back(*it);
+	}
+
+	for (map<WayGroupKey,list<const Way*> >::const_iterator it = groups.begin(); it != groups.end(); it++) {
+		const double real_width = it->first.width;
+		list<WayLine> lines;
+		JoinWaysToLines(it->second, &lines);
+		for (list<WayLine>::const_iterator it2 = lines.begin(); it2 != lines.end(); it2++) {
+			this->addFeatureToIndex(it2->way_ids);
+			if (this->scene_writer.writesComments()) this->scene_writer.writeComment(GetWayLineComment(*it2, " with border", key, value, real_width).c_str());
+			drawWay(it2->nodes, real_width, it->first.height-0.0011, border_style, true, it->first.links_also_in_margin);
+			drawWay(it2->nodes, real_width-border_width_percent*real_width/100*2, it->first.height, it->first.is_tunnel && strcmp(style, "highway") == 0 ? "highway_tunnel" : style, true, true);
 		}
-		drawWay((*it)->getNodes(), real_width, height-0.0011+extra_layer, border_style, true, extra_layer == 0);
-		drawWay((*it)->getNodes(), real_width-border_width_percent*real_width/100*2, height+extra_layer, is_tunnel && strcmp(style, "highway") == 0 ? "highway_tunnel" : style, true, true);
 	}
 }
 
@@ -220,194 +359,288 @@ void Osm2PovConverter::drawArea(uint64_t area_id, const vector<const Node*> &nod
 	vector<double> coords;
 
 	for (vector<const Node*>::const_iterator it2 = nodes.begin(); it2 != nodes.end(); it2++) {
-		double lat = this->pov_writer.convertLatToCoord((*it2)->getLat());
-		double lon = this->pov_writer.convertLonToCoord((*it2)->getLon());
+		double lat = this->scene_writer.convertLatToCoord((*it2)->getLat());
+		double lon = this->scene_writer.convertLonToCoord((*it2)->getLon());
 
 		coords.push_back(lon);
-		coords.push_back(metres2unit(height));
+		coords.push_back(this->scene_writer.convertMetresToCoord(height));
 		coords.push_back(lat);
 	}
 
 	Polygon3D polygon(area_id, coords);
-	this->pov_writer.writePolygon(polygon, style);
+	this->scene_writer.writePolygon(polygon, style);
+}
+
+//Multipolygons with the attribute and their triangles, triangulated in parallel. With feature cache they are taken
+//from it (they are triangulated only once for all tiles) and only triangles in interest rectangle are returned.
+void Osm2PovConverter::getAreas(const char *key, const char *value, vector<TileArea> *output) {
+	if (this->feature_cache == NULL) {
+		list<MultiPolygon*> multipolygons;
+		this->primitives.getMultiPolygonsWithAttribute(&multipolygons, key, value);
+		output->resize(multipolygons.size());
+		size_t i = 0;
+		for (list<MultiPolygon*>::const_iterator it = multipolygons.begin(); it != multipolygons.end(); it++) (*output)[i++].multipolygon = *it;
+		ParallelFor(this->task_pool, output->size(), [output](size_t i) {
+			(*output)[i].multipolygon->convertToTriangles(&(*output)[i].triangles);
+		});
+	}
+	else {
+		vector<shared_ptr<CachedArea> > cached_areas;
+		this->primitives.getCachedAreasWithAttribute(&cached_areas, key, value, this->feature_cache);
+		const Rect interest_rect = this->primitives.getInterestRect();
+		output->resize(cached_areas.size());
+		ParallelFor(this->task_pool, output->size(), [&](size_t i) {
+			(*output)[i].multipolygon = &cached_areas[i]->getMultiPolygon();
+			(*output)[i].cached_area = cached_areas[i];
+			cached_areas[i]->getTrianglesInRect(interest_rect, &(*output)[i].triangles);
+		});
+	}
 }
 
+//Areas are triangulated in parallel and then written in the original order
 void Osm2PovConverter::drawAreas(const char *key, const char *value, double height, const char *style) {
-	list<MultiPolygon*> multipolygons;
-	this->primitives.getMultiPolygonsWithAttribute(&multipolygons, key, value);
-	for (list<MultiPolygon*>::iterator it = multipolygons.begin(); it != multipolygons.end(); it++) {
-		const char *extra_layer_str = (*it)->getAttribute("layer");
+	RuleScope rule_scope(*this, "areas", key, value, style);
+	vector<TileArea> areas;
+	this->getAreas(key, value, &areas);
+
+	for (size_t i = 0; i < areas.size(); i++) {
+		const MultiPolygon *multipolygon = areas[i].multipolygon;
+		if (areas[i].cached_area != NULL && areas[i].triangles.empty()) continue;		//it's only in other tiles
+
+		const char *extra_layer_str = multipolygon->getAttribute("layer");
 		double extra_layer = (extra_layer_str == NULL ? 0 : atof(extra_layer_str)/500);
 		if (extra_layer < 0) extra_layer = 0;
 
-		{
+		this->addFeatureToIndex(multipolygon->getId());
+		if (this->scene_writer.writesComments()) {
 			stringstream s;
-			s << "Area (closed way) " << (*it)->getId() << " (tag " << key;
+			s << "Area (closed way) " << multipolygon->getId() << " (tag " << key;
 			if (value != NULL) s << "=" << value;
 			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->scene_writer.writeComment(s.str().c_str());
 		}
 
-		vector<Triangle> triangles;
-		(*it)->convertToTriangles(&triangles);
-		this->pov_writer.writePolygon((*it)->getId(), triangles, height+extra_layer, style);
+		this->scene_writer.writePolygon(multipolygon->getId(), areas[i].triangles, height+extra_layer, style);
 
-		delete *it;
+		if (areas[i].cached_area == NULL) delete multipolygon;
 	}
 }
 
+//Forests are triangulated and filled by trees in parallel and then written in the original order. Trees avoid points
+//of objects drawn before (see PointField), but they don't add any points, so forests don't depend on each other.
+//Only trees in interest rectangle are computed, they are the same in every tile (see ComputeRegularInsidePoints()).
 void Osm2PovConverter::drawForests(const char *key, const char *value, double floor_height, const char *floor_style, const char *tree_style_basic, size_t tree_style_coniferous_min, size_t tree_style_coniferous_max, size_t tree_style_overall_max) {
-	list<MultiPolygon*> multipolygons;
-	this->primitives.getMultiPolygonsWithAttribute(&multipolygons, key, value);
-	for (list<MultiPolygon*>::iterator it = multipolygons.begin(); it != multipolygons.end(); it++) {
-		const char *extra_layer_str = (*it)->getAttribute("layer");
+	RuleScope rule_scope(*this, "forests", key, value, floor_style);
+	vector<TileArea> areas;
+	this->getAreas(key, value, &areas);
+	vector<vector<PointFieldItem*> > trees(areas.size());
+	const Rect interest_rect = this->primitives.getInterestRect();
+	ParallelFor(this->task_pool, areas.size(), [&](size_t i) {
+		if (!this->drawsSmallObjects()) return;
+
+		const MultiPolygon *multipolygon = areas[i].multipolygon;
+		const char *wood_style = multipolygon->getAttribute("wood");
+		size_t tree_style_min = tree_style_coniferous_min;
+		size_t tree_style_max = tree_style_overall_max;
+		if (wood_style != NULL) {
+			if (strcmp(wood_style, "coniferous") == 0) tree_style_max = tree_style_coniferous_max;
+			else if (strcmp(wood_style, "deciduous") == 0) tree_style_min = tree_style_coniferous_max+1;
+		}
+
+		TraceSpan trace_span("feature", "trees", multipolygon->getId(), TRACE_MIN_FEATURE_SECONDS);
+		ComputeRegularInsidePoints(&areas[i].triangles, &trees[i], &this->point_field, multipolygon->getId(), interest_rect, tree_style_min, tree_style_max);
+	});
+
+	for (size_t i = 0; i < areas.size(); i++) {
+		const MultiPolygon *multipolygon = areas[i].multipolygon;
+		if (areas[i].cached_area != NULL && areas[i].triangles.empty()) continue;		//it's only in other tiles
+
+		const char *extra_layer_str = multipolygon->getAttribute("layer");
 		double extra_layer = (extra_layer_str == NULL ? 0 : atof(extra_layer_str)/500);
 		if (extra_layer < 0) extra_layer = 0;
 
-		{
-			stringstream s;
-			s << "Forest with id " << (*it)->getId() << " - outline (tag " << key;
-			if (value != NULL) s << "=" << value;
-			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
-		}
-
-		vector<Triangle> triangles;
-		(*it)->convertToTriangles(&triangles);
-		this->pov_writer.writePolygon((*it)->getId(), triangles, floor_height+extra_layer, floor_style);
-		{
+		this->addFeatureToIndex(multipolygon->getId());
+		if (this->scene_writer.writesComments()) {
 			stringstream s;
-			s << "Forest with id " << (*it)->getId() << " - trees (tag " << key;
+			s << "Forest with id " << multipolygon->getId() << " - outline (tag " << key;
 			if (value != NULL) s << "=" << value;
 			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->scene_writer.writeComment(s.str().c_str());
 		}
 
-		const char *wood_style = (*it)->getAttribute("wood");
-		size_t tree_style_min = tree_style_coniferous_min;
-		size_t tree_style_max = tree_style_overall_max;
-		if (wood_style != NULL) {
-			if (strcmp(wood_style, "coniferous") == 0) tree_style_max = tree_style_coniferous_max;
-			else if (strcmp(wood_style, "deciduous") == 0) tree_style_min = tree_style_coniferous_max+1;
+		this->scene_writer.writePolygon(multipolygon->getId(), areas[i].triangles, floor_height+extra_layer, floor_style);
+		if (this->drawsSmallObjects()) {
+			this->addFeatureToIndex(multipolygon->getId());
+			if (this->scene_writer.writesComments()) {
+				stringstream s;
+				s << "Forest with id " << multipolygon->getId() << " - trees (tag " << key;
+				if (value != NULL) s << "=" << value;
+				s << ")";
+				this->scene_writer.writeComment(s.str().c_str());
+			}
 		}
 
-		vector<PointFieldItem*> trees;
-		ComputeRegularInsidePoints(&triangles, &trees, &this->point_field, tree_style_min, tree_style_max);
-
-		for (vector<PointFieldItem*>::iterator it2 = trees.begin(); it2 != trees.end(); it2++) {
-			this->pov_writer.writeSprite((*it2)->xy->x, (*it2)->xy->y, tree_style_basic, (*it2)->item_type, 0.3);
-			delete (*it2)->xy;
-			delete *it2;
+		for (vector<PointFieldItem*>::iterator it = trees[i].begin(); it != trees[i].end(); it++) {
+			this->scene_writer.writeSprite((*it)->xy->x, (*it)->xy->y, tree_style_basic, (*it)->item_type, 0.3);
+			delete (*it)->xy;
+			delete *it;
 		}
 
-		delete *it;
+		if (areas[i].cached_area == NULL) delete multipolygon;
 	}
 }
 
 void Osm2PovConverter::drawObjects(const char *key, const char *value, const char *style_basic, double scale, int min_variation, int max_variation) {
+	RuleScope rule_scope(*this, "objects", key, value, style_basic);
 	list<const Node*> nodes;
 	this->primitives.getNodesWithAttribute(&nodes, key, value);
+	if (!this->drawsSmallObjects()) return;
 	for (list<const Node*>::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
-		{
+		this->addFeatureToIndex((*it)->getId());
+		if (this->scene_writer.writesComments()) {
 			stringstream s;
 			s << "Node " << (*it)->getId() << " (tag " << key;
 			if (value != NULL) s << "=" << value;
 			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->scene_writer.writeComment(s.str().c_str());
 		}
 
-		this->pov_writer.writeSprite((*it)->getLon(), (*it)->getLat(), style_basic, rand() % (max_variation-min_variation+1) + min_variation, scale);
+		RandomGenerator random((*it)->getId());
+		this->scene_writer.writeSprite((*it)->getLon(), (*it)->getLat(), style_basic, random.nextBelow(max_variation-min_variation+1) + min_variation, scale);
 	}
 }
 
-void Osm2PovConverter::drawBuildingWalls(const vector<XY> &points, double min_height, double height, const char *style) {
-	bool first = true;
-	double x_before, y_before;
-
-	double lon_before, lat_before;
+void Osm2PovConverter::addBuildingWalls(const vector<XY> &points, double min_height, double height, const char *style, Mesh *mesh) const {
+	size_t bottom_before = 0, top_before = 0;
+	double x_before = 0, y_before = 0;
 	for (vector<XY>::const_iterator it = points.begin(); it != points.end(); it++) {
-		double x = this->pov_writer.convertLonToCoord(it->x);
-		double y = this->pov_writer.convertLatToCoord(it->y);
-
-		if (first) {
-			this->point_field.addPoint(it->x, it->y, metres2unit(3.5)*2);
-			first = false;
-		}
-		else {
-			this->point_field.addPointsInDistance(lon_before, lat_before, it->x, it->y, metres2unit(3.5)*2);
-
-			vector<double> coords;
-
-			coords.push_back(x);
-			coords.push_back(metres2unit(min_height));
-			coords.push_back(y);
-
-			coords.push_back(x);
-			coords.push_back(metres2unit(height));
-			coords.push_back(y);
+		double x = this->scene_writer.convertLonToCoord(it->x);
+		double y = this->scene_writer.convertLatToCoord(it->y);
 
-			coords.push_back(x_before);
-			coords.push_back(metres2unit(height));
-			coords.push_back(y_before);
+		if (it != points.begin() && fabs(x-x_before) <= COMP_PRECISION && fabs(y-y_before) <= COMP_PRECISION) continue;		//two same points
 
-			coords.push_back(x_before);
-			coords.push_back(metres2unit(min_height));
-			coords.push_back(y_before);
+		const size_t bottom = mesh->addVertex(x, this->scene_writer.convertMetresToCoord(min_height), y);
+		const size_t top = mesh->addVertex(x, this->scene_writer.convertMetresToCoord(height), y);
+		if (it != points.begin() && height != min_height) {
+			mesh->addQuad(bottom, top, top_before, bottom_before, style);
+		}
 
-			coords.push_back(x);
-			coords.push_back(metres2unit(min_height));
-			coords.push_back(y);
+		bottom_before = bottom; top_before = top;
+		x_before = x; y_before = y;
+	}
+}
 
-			Polygon3D polygon(0, coords);
+//walls of building are added to point field separately from its mesh, because meshes are created in parallel
+void Osm2PovConverter::addBuildingToPointField(const MultiPolygon &multipolygon) {
+	const list<vector<XY> > *parts[2] = { &multipolygon.getOuterParts(), &multipolygon.getHoles() };
+	for (size_t i = 0; i < 2; i++) {
+		for (list<vector<XY> >::const_iterator it = parts[i]->begin(); it != parts[i]->end(); it++) {
+			double x_before = 0, y_before = 0;
+			double lon_before = 0, lat_before = 0;
+			for (vector<XY>::const_iterator it2 = it->begin(); it2 != it->end(); it2++) {
+				double x = this->scene_writer.convertLonToCoord(it2->x);
+				double y = this->scene_writer.convertLatToCoord(it2->y);
+
+				if (it2 == it->begin()) {
+					this->point_field.addPoint(it2->x, it2->y, metres2unit(3.5)*2);
+				}
+				else {
+					this->point_field.addPointsInDistance(lon_before, lat_before, it2->x, it2->y, metres2unit(3.5)*2);
+					if (fabs(x-x_before) <= COMP_PRECISION && fabs(y-y_before) <= COMP_PRECISION) continue;		//two same points
+				}
+
+				x_before = x; y_before = y;
+				lon_before = it2->x; lat_before = it2->y;
+			}
+		}
+	}
+}
 
-			this->pov_writer.writePolygon(polygon, style);
+//adds horizontal area (roof or floor) of building to mesh; the triangles share vertices where they share points
+void Osm2PovConverter::addBuildingArea(uint64_t building_id, const vector<Triangle> &triangles, double height, const char *style, Mesh *mesh) const {
+	map<const XY*,size_t> vertices;
+	for (vector<Triangle>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+		double x[3], y[3];
+		for (size_t i = 0; i < 3; i++) {
+			x[i] = this->scene_writer.convertLonToCoord(it->getX(i));
+			y[i] = this->scene_writer.convertLatToCoord(it->getY(i));
+		}
+		bool degenerated = false;		//the same check (in scene coords) as in PovWriter::writeTriangle()
+		for (size_t i = 0; i < 3; i++) {
+			if (fabs(x[i]-x[(i+1)%3]) <= COMP_PRECISION && fabs(y[i]-y[(i+1)%3]) <= COMP_PRECISION) degenerated = true;
+		}
+		if (degenerated) {
+			g_diagnostics.add(diagnostic_degenerated_triangle, building_id);
+			continue;
 		}
 
-		x_before = x; y_before = y;
-		lon_before = it->x; lat_before = it->y;
+		size_t triangle[3];
+		for (size_t i = 0; i < 3; i++) {
+			map<const XY*,size_t>::const_iterator vertex_it = vertices.find(it->getXY(i));
+			if (vertex_it != vertices.end()) triangle[i] = vertex_it->second;
+			else {
+				triangle[i] = vertices[it->getXY(i)] = mesh->addVertex(x[i], this->scene_writer.convertMetresToCoord(height), y[i]);
+			}
+		}
+		mesh->addTriangle(triangle[0], triangle[1], triangle[2], style);
 	}
 }
 
-void Osm2PovConverter::drawBuilding(const MultiPolygon &multipolygon, double min_height, double height, const char *style, const char *roof_style) {
+//Whole building (walls, roof and floor) is one mesh, footprint is triangulated only once
+void Osm2PovConverter::addBuildingMesh(const MultiPolygon &multipolygon, double min_height, double height, const char *style, const char *roof_style, Mesh *mesh) const {
 	{		//outer walls of building
 		const list<vector<XY> > &outer_parts = multipolygon.getOuterParts();
 		for (list<vector<XY> >::const_iterator it = outer_parts.begin(); it != outer_parts.end(); it++) {
-			this->drawBuildingWalls(*it, min_height, height, style);
+			this->addBuildingWalls(*it, min_height, height, style, mesh);
 		}
 	}
 	{		//inner walls of building (if building have any)
 		const list<vector<XY> > &holes = multipolygon.getHoles();
 		for (list<vector<XY> >::const_iterator it = holes.begin(); it != holes.end(); it++) {
-			this->drawBuildingWalls(*it, min_height, height, style);
+			this->addBuildingWalls(*it, min_height, height, style, mesh);
 		}
 	}
 
-	if (roof_style != NULL) {		//roof
+	if (roof_style != NULL || min_height != 0) {
 		vector<Triangle> triangles;
 		multipolygon.convertToTriangles(&triangles);
-		this->pov_writer.writePolygon(multipolygon.getId(), triangles, height, roof_style);
+		if (roof_style != NULL) this->addBuildingArea(multipolygon.getId(), triangles, height, roof_style, mesh);
+		if (min_height != 0) this->addBuildingArea(multipolygon.getId(), triangles, min_height, style, mesh);		//when building isn't at floor, render floor too
 	}
+}
 
-	if (min_height != 0) {		//when building isn't at floor, render floor too
-		vector<Triangle> triangles;
-		multipolygon.convertToTriangles(&triangles);
-		this->pov_writer.writePolygon(multipolygon.getId(), triangles, min_height, style);
-	}
+void Osm2PovConverter::drawBuilding(const MultiPolygon &multipolygon, double min_height, double height, const char *style, const char *roof_style) {
+	this->addBuildingToPointField(multipolygon);
+	Mesh mesh;
+	this->addBuildingMesh(multipolygon, min_height, height, style, roof_style, &mesh);
+	this->scene_writer.writeMesh(mesh);
 }
 
+struct BuildingToDraw {
+	MultiPolygon *multipolygon;
+	double min_height, height;
+	const char *style, *roof_style;
+	Mesh mesh;
+};
+
+//Meshes of buildings are created in parallel and then written in the original order
+
 void Osm2PovConverter::drawBuildings(const char *key, const char *value, double default_height, const vector<const char*> &style, const vector<const char*> &roof_style_living, const vector<const char*> &roof_style_nonliving, const vector<const char*> &roof_style_religious) {
+	RuleScope rule_scope(*this, "buildings", key, value, NULL);
 	list<MultiPolygon*> multipolygons;
 	this->primitives.getMultiPolygonsWithAttribute(&multipolygons, key, value);
+	vector<BuildingToDraw> buildings;
+	buildings.reserve(multipolygons.size());
 	for (list<MultiPolygon*>::iterator it = multipolygons.begin(); it != multipolygons.end(); it++) {
 		const char *str;
 		str = (*it)->getAttribute("layer");
 		double extra_layer = (str == NULL ? 0 : atof(str)/500);
-		if (extra_layer < 0) continue; //skip objects under the ground
 
-		 //don't render towers twice (later as special building) (this isn't nice piece of code - duplicating)
-		if ((*it)->hasAttribute("man_made", "tower")) continue;
-		if ((*it)->hasAttribute("amenity", "tower")) continue;
-		if ((*it)->hasAttribute("man_made", "chimney")) continue;
+		//skip objects under the ground and don't render towers twice (later as special building) (this isn't nice piece of code - duplicating)
+		if (extra_layer < 0 || (*it)->hasAttribute("man_made", "tower") || (*it)->hasAttribute("amenity", "tower") || (*it)->hasAttribute("man_made", "chimney")) {
+			delete *it;
+			continue;
+		}
 
 
 		double height = default_height;
@@ -432,14 +665,6 @@ void Osm2PovConverter::drawBuildings(const char *key, const char *value, double
 			extra_layer = 0;			//when has building min_height, it's more precise than layer
 		}
 		
-		{
-			stringstream s;
-			s << "Building " << (*it)->getId() << " (tag " << key;
-			if (value != NULL) s << "=" << value;
-			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
-		}
-
 		BuildingType building_type = getBuildingType(**it, height, min_height);
 
 		const vector<const char*> *roof_style;
@@ -457,12 +682,38 @@ void Osm2PovConverter::drawBuildings(const char *key, const char *value, double
 				break;
 		}
 
-		this->drawBuilding(**it, min_height, height+extra_layer, style[(*it)->getId() % style.size()], (*roof_style)[(*it)->getId() % roof_style->size()]);
-		delete *it;
+		buildings.push_back(BuildingToDraw());
+		BuildingToDraw &building = buildings.back();
+		building.multipolygon = *it;
+		building.min_height = min_height;
+		building.height = height+extra_layer;
+		building.style = style[(*it)->getId() % style.size()];
+		building.roof_style = (*roof_style)[(*it)->getId() % roof_style->size()];
+	}
+
+	ParallelFor(this->task_pool, buildings.size(), [&](size_t i) {
+		const BuildingToDraw &building = buildings[i];
+		this->addBuildingMesh(*building.multipolygon, building.min_height, building.height, building.style, building.roof_style, &buildings[i].mesh);
+	});
+
+	for (vector<BuildingToDraw>::iterator it = buildings.begin(); it != buildings.end(); it++) {
+		this->addFeatureToIndex(it->multipolygon->getId());
+		if (this->scene_writer.writesComments()) {
+			stringstream s;
+			s << "Building " << it->multipolygon->getId() << " (tag " << key;
+			if (value != NULL) s << "=" << value;
+			s << ")";
+			this->scene_writer.writeComment(s.str().c_str());
+		}
+
+		this->addBuildingToPointField(*it->multipolygon);
+		this->scene_writer.writeMesh(it->mesh);
+		delete it->multipolygon;
 	}
 }
 
 void Osm2PovConverter::drawSpecialBuildings(const char *key, const char *value, double default_height, const char *style, const char *roof_style) {
+	RuleScope rule_scope(*this, "special_buildings", key, value, style);
 	list<MultiPolygon*> multipolygons;
 	this->primitives.getMultiPolygonsWithAttribute(&multipolygons, key, value);
 	for (list<MultiPolygon*>::iterator it = multipolygons.begin(); it != multipolygons.end(); it++) {
@@ -485,12 +736,13 @@ void Osm2PovConverter::drawSpecialBuildings(const char *key, const char *value,
 			extra_layer = 0;			//when has building min_height, it's more precise than layer
 		}
 
-		{
+		this->addFeatureToIndex((*it)->getId());
+		if (this->scene_writer.writesComments()) {
 			stringstream s;
 			s << "Building " << (*it)->getId() << " (tag " << key;
 			if (value != NULL) s << "=" << value;
 			s << ")";
-			this->pov_writer.writeComment(s.str().c_str());
+			this->scene_writer.writeComment(s.str().c_str());
 		}
 
 		this->drawBuilding(**it, min_height, height+extra_layer, style, roof_style);
@@ -3,27 +3,64 @@
 
 #include "primitives.h"
 
+//Area drawn in tile; with feature cache it's shared with other tiles and only its triangles in tile are drawn
+struct TileArea {
+	const class MultiPolygon *multipolygon;		//it must be deleted when the area isn't cached
+	vector<class Triangle> triangles;
+	shared_ptr<class CachedArea> cached_area;		//NULL without feature cache
+};
+
 class Osm2PovConverter {
 	private:
-	class Primitives &primitives;
-	class PovWriter &pov_writer;
+	class PrimitivesView &primitives;
+	class SceneWriter &scene_writer;
+	class TaskPool *task_pool;		//geometry of features is computed in parallel when it isn't NULL
 	PointField point_field;
+	class Stats *stats;		//NULL when statistics aren't collected
+	class FeatureCache *feature_cache;		//NULL when areas aren't shared with other tiles
+	class SceneIndex *scene_index;		//NULL when index of objects isn't written
+	const string *rule_name;		//name of rule which is drawn, it's set by RuleScope only when scene index is written
+	class RuleScope;
 	enum BuildingType {
 		living_building,
 		nonliving_building,
 		worship_building,
 	};
+	struct WayGroupKey {		//ways with the same key are joined to continuous lines
+		double width;
+		double height;
+		bool links_also_in_margin;
+		bool is_tunnel;
+
+		bool operator<(const WayGroupKey &other) const {
+			if (this->width != other.width) return (this->width < other.width);
+			if (this->height != other.height) return (this->height < other.height);
+			if (this->links_also_in_margin != other.links_also_in_margin) return (this->links_also_in_margin < other.links_also_in_margin);
+			return (this->is_tunnel < other.is_tunnel);
+		}
+	};
 
+	bool drawsSmallObjects() const;
 	static double readDimension(const char *dimension_text);
 	static double computeWayWidth(const Way &way, double default_width);
 	static BuildingType getBuildingType(const MultiPolygon &building, double height, double min_height);
 	void drawWay(const vector<const class Node*> &nodes, double width, double height, const char *style, bool including_links, bool links_also_in_margin);
+	void addBuildingMesh(const class MultiPolygon &multipolygon, double min_height, double height, const char *style, const char *roof_style, class Mesh *mesh) const;
+	void addBuildingToPointField(const class MultiPolygon &multipolygon);
 	void drawBuilding(const class MultiPolygon &multipolygon, double min_height, double height, const char *style, const char *roof_style);
-	void drawBuildingWalls(const vector<class XY> &points, double min_height, double height, const char *style);
+	void addBuildingWalls(const vector<class XY> &points, double min_height, double height, const char *style, class Mesh *mesh) const;
+	void addBuildingArea(uint64_t building_id, const vector<class Triangle> &triangles, double height, const char *style, class Mesh *mesh) const;
 	void drawArea(uint64_t area_id, const vector<const class Node*> &nodes, double height, const char *style);
+	void getAreas(const char *key, const char *value, vector<struct TileArea> *output);
+	void addFeatureToIndex(uint64_t id);
+	void addFeatureToIndex(const list<uint64_t> &ids);
 
 	public:
-	Osm2PovConverter(Primitives &primitives, PovWriter &pov_writer) : primitives(primitives), pov_writer(pov_writer) { }
+	Osm2PovConverter(PrimitivesView &primitives, SceneWriter &scene_writer, TaskPool *task_pool)
+	 : primitives(primitives), scene_writer(scene_writer), task_pool(task_pool), stats(NULL), feature_cache(NULL), scene_index(NULL), rule_name(NULL) { }
+	void setStats(Stats *stats) { this->stats = stats; }
+	void setFeatureCache(FeatureCache *feature_cache) { this->feature_cache = feature_cache; }
+	void setSceneIndex(SceneIndex *scene_index) { this->scene_index = scene_index; }
 	void drawTowers(const char *key, const char *value, double width, double default_height, const char *style);
 	void drawWays(const char *key, const char *value, double width, double height, const char *style, bool including_links, bool area_possible);
 	void drawWaysWithBorder(const char *key, const char *value, double width, double height, const char *style, double border_width_percent, const char *border_style);
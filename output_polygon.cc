@@ -1,19 +1,20 @@
 
 #include "global.h"
 #include "output_polygon.h"
+#include "diagnostics.h"
 #include "point_field.h"
+#include "random_generator.h"
 #include "primitives.h"
+#include "trace.h"
 
 Polygon3D::Polygon3D(uint64_t area_id, const vector<double> &coords) {
-	this->points_count = 0;
 	this->is_valid = this->addPart(area_id, coords);
 }
 
 bool Polygon3D::addPart(uint64_t area_id, const vector<double> &coords) {
 	assert(coords.size()%3 == 0);
 
-	stringstream str;
-	str.precision(12);
+	const size_t first_point = this->points.size();
 	size_t area_points = 0;
 
 	bool at_least_two_same_points = false;
@@ -25,33 +26,152 @@ bool Polygon3D::addPart(uint64_t area_id, const vector<double> &coords) {
 			at_least_two_same_points = true;
 			continue;		//two same points
 		}
-		str << ",<" << coords[i] << "," << coords[i+1] << "," << coords[i+2] << ">";
+		this->points.insert(this->points.end(), coords.begin()+i, coords.begin()+i+3);
 		area_points++;
 	}
-	if (at_least_two_same_points && !g_quiet_mode)
-		cerr << "Polygon with id " << area_id << " has at least two same points next to other." << endl;
+	if (at_least_two_same_points) g_diagnostics.add(diagnostic_duplicate_points, area_id);
 
 	if (coords.size() >= 6 && (coords[0] != coords[coords.size()-3] || coords[1] != coords[coords.size()-2] || coords[2] != coords[coords.size()-1])) {
-		str << ",<" << coords[0] << "," << coords[1] << "," << coords[2] << ">";
+		this->points.insert(this->points.end(), coords.begin(), coords.begin()+3);
 		area_points++;
-		cerr << "Polygon with id " << area_id << " isn't closed, closing." << endl;
+		g_diagnostics.add(diagnostic_not_closed, area_id);
 	}
 
 	if (area_points < 4) {
-		cerr << "Polygon with id " << area_id << " has only " << (area_points-1) << " different points, ignore it." << endl;
+		g_diagnostics.add(diagnostic_few_points, area_id);
+		this->points.resize(first_point);
 		return false;
 	}
 
-	this->points_count += area_points;
-	if (this->coords_output != "") this->coords_output += str.str();
-	else this->coords_output += str.str().substr(1);		//without coma at beginning
 	return true;
 }
 
+string Polygon3D::getCoordsOutput() const {
+	assert(this->is_valid);
+
+	stringstream str;
+	str.precision(12);
+	for (size_t i = 0; i < this->points.size(); i += 3) {
+		str << (i == 0 ? "<" : ",<") << this->points[i] << "," << this->points[i+1] << "," << this->points[i+2] << ">";
+	}
+	return str.str();
+}
+
 void Polygon3D::addHole(uint64_t area_id, const vector<double> &coords) {
 	this->addPart(area_id, coords);
 }
 
+size_t Mesh::addVertex(double x, double y, double z) {
+	this->vertices.push_back(x);
+	this->vertices.push_back(y);
+	this->vertices.push_back(z);
+	return this->vertices.size()/3-1;
+}
+
+void Mesh::addTriangle(size_t a, size_t b, size_t c, const char *style) {
+	size_t style_index = 0;
+	while (style_index < this->styles.size() && strcmp(this->styles[style_index], style) != 0) style_index++;
+	if (style_index == this->styles.size()) this->styles.push_back(style);
+
+	this->faces.push_back(a);
+	this->faces.push_back(b);
+	this->faces.push_back(c);
+	this->faces.push_back(style_index);
+}
+
+void Mesh::addQuad(size_t a, size_t b, size_t c, size_t d, const char *style) {
+	this->addTriangle(a, b, c, style);
+	this->addTriangle(a, c, d, style);
+}
+
+#define MITER_LIMIT_COS 0.5		//sharper joins than 120 degrees are beveled
+
+//vertices of ribbon cross section at one point of line
+struct RibbonSection {
+	size_t left_top, left_bottom, right_top, right_bottom;
+};
+
+static RibbonSection AddRibbonSection(const XY &point, double offset_x, double offset_y, double height, Mesh *mesh) {
+	RibbonSection section;
+	section.left_top = mesh->addVertex(point.x+offset_x, height, point.y+offset_y);
+	section.left_bottom = mesh->addVertex(point.x+offset_x, 0, point.y+offset_y);
+	section.right_top = mesh->addVertex(point.x-offset_x, height, point.y-offset_y);
+	section.right_bottom = mesh->addVertex(point.x-offset_x, 0, point.y-offset_y);
+	return section;
+}
+
+//Extrudes line (in output coords) to solid band with given width from 0 to height. Neighbour segments are joined
+//by miter, or by bevel when the angle is too sharp. Closed line (first point is the same as last) has no ends.
+void AddRibbonToMesh(const vector<XY> &line, double width, double height, const char *style, Mesh *mesh) {
+	vector<XY> points;
+	for (vector<XY>::const_iterator it = line.begin(); it != line.end(); it++) {
+		if (!points.empty() && fabs(it->x-points.back().x) <= COMP_PRECISION && fabs(it->y-points.back().y) <= COMP_PRECISION) continue;
+		points.push_back(*it);
+	}
+	if (points.size() < 2) return;
+
+	bool is_closed = false;
+	if (points.size() > 3 && fabs(points.front().x-points.back().x) <= COMP_PRECISION && fabs(points.front().y-points.back().y) <= COMP_PRECISION) {
+		is_closed = true;
+		points.pop_back();
+	}
+	const size_t count = points.size();
+	const size_t segments_count = (is_closed ? count : count-1);
+	const double half_width = width/2;
+
+	vector<XY> normals(segments_count);		//unit normal on left side of every segment
+	for (size_t i = 0; i < segments_count; i++) {
+		const XY &a = points[i], &b = points[(i+1)%count];
+		const double length = sqrt((b.x-a.x)*(b.x-a.x) + (b.y-a.y)*(b.y-a.y));
+		normals[i] = XY(-(b.y-a.y)/length, (b.x-a.x)/length);
+	}
+
+	vector<RibbonSection> sections_in(count), sections_out(count);		//end of segment before and start of segment after point
+	for (size_t i = 0; i < count; i++) {
+		const bool has_segment_in = (is_closed || i > 0), has_segment_out = (is_closed || i < count-1);
+		if (!has_segment_in || !has_segment_out) {		//end of line
+			const XY &normal = normals[has_segment_out ? i : i-1];
+			sections_in[i] = sections_out[i] = AddRibbonSection(points[i], normal.x*half_width, normal.y*half_width, height, mesh);
+			const RibbonSection &section = sections_in[i];
+			mesh->addQuad(section.left_top, section.right_top, section.right_bottom, section.left_bottom, style);
+			continue;
+		}
+
+		const XY &normal_in = normals[(i+segments_count-1)%segments_count], &normal_out = normals[i%segments_count];
+		const double miter_x = normal_in.x+normal_out.x, miter_y = normal_in.y+normal_out.y;
+		const double miter_length = sqrt(miter_x*miter_x + miter_y*miter_y);
+		const double cos_half_angle = (miter_length > COMP_PRECISION ? (miter_x*normal_in.x + miter_y*normal_in.y)/miter_length : 0);
+		if (cos_half_angle >= MITER_LIMIT_COS) {
+			const double scale = half_width / cos_half_angle / miter_length;
+			sections_in[i] = sections_out[i] = AddRibbonSection(points[i], miter_x*scale, miter_y*scale, height, mesh);
+			continue;
+		}
+
+		//bevel: both segments end with square section and the gap on outer side is filled by triangle
+		const RibbonSection in = AddRibbonSection(points[i], normal_in.x*half_width, normal_in.y*half_width, height, mesh);
+		const RibbonSection out = AddRibbonSection(points[i], normal_out.x*half_width, normal_out.y*half_width, height, mesh);
+		sections_in[i] = in;
+		sections_out[i] = out;
+		const size_t center = mesh->addVertex(points[i].x, height, points[i].y);
+		const bool turns_left = (normal_in.x*normal_out.y - normal_in.y*normal_out.x > 0);
+		if (turns_left) {
+			mesh->addTriangle(center, in.right_top, out.right_top, style);
+			mesh->addQuad(in.right_top, out.right_top, out.right_bottom, in.right_bottom, style);
+		}
+		else {
+			mesh->addTriangle(center, in.left_top, out.left_top, style);
+			mesh->addQuad(in.left_top, out.left_top, out.left_bottom, in.left_bottom, style);
+		}
+	}
+
+	for (size_t i = 0; i < segments_count; i++) {
+		const RibbonSection &a = sections_out[i], &b = sections_in[(i+1)%count];
+		mesh->addQuad(a.left_top, b.left_top, b.right_top, a.right_top, style);
+		mesh->addQuad(a.left_bottom, b.left_bottom, b.left_top, a.left_top, style);
+		mesh->addQuad(a.right_top, b.right_top, b.right_bottom, a.right_bottom, style);
+	}
+}
+
 MultiPolygon::MultiPolygon(const Relation *relation, const Rect &interest_rect)
  : is_valid(false), is_done(false), relation(relation), interest_rect(interest_rect) {
 }
@@ -206,20 +326,19 @@ static bool AddPolygonToList(const list<const Way*> &ways, list<vector<XY> > *ou
 				}
 			}
 
-			if (count_of_two_same_points > 0 && !g_quiet_mode)
-				cerr << "Polygon (way or relation of ways) with way with id " << (*ways.begin())->getId() << " has " << count_of_two_same_points << " duplicites (two same nodes (or nodes with the same coords) next to other)." << endl;
+			if (count_of_two_same_points > 0) g_diagnostics.add(diagnostic_duplicate_points, (*ways.begin())->getId());
 
 			if (output_part.size() >= 2 &&
 				(output_part[0].x != output_part[output_part.size()-1].x || output_part[0].y != output_part[output_part.size()-1].y)) {
 
 				output_part.push_back(XY(output_part[0].x, output_part[0].y));
-				cerr << "Polygon (way or relation of ways) with way with id " << (*ways.begin())->getId() << " isn't closed, closing." << endl;
+				g_diagnostics.add(diagnostic_not_closed, (*ways.begin())->getId());
 			}
 
 			bool success = true;
 
 			if (output_part.size() < 3+1) {
-				cerr << "Polygon (way or relation of ways) with way with id " << (*ways.begin())->getId() << " has only " << (output_list->size()-1) << " different points, ignore it." << endl;
+				g_diagnostics.add(diagnostic_few_points, (*ways.begin())->getId());
 				success = false;
 			}
 			else {
@@ -322,6 +441,11 @@ uint64_t MultiPolygon::getId() const {
 	return (*this->outer_ways.begin())->getId();
 }
 
+//returns 0 when polygon isn't in any relation
+uint64_t MultiPolygon::getRelationId() const {
+	return (this->relation == NULL ? 0 : this->relation->getId());
+}
+
 size_t MultiPolygon::getPointsCount() const {
 	assert(this->is_done);
 	assert(this->isValid());
@@ -366,80 +490,48 @@ bool IsPointInTriangle(const XY *point, const XY *tr_point1, const XY *tr_point2
 	return true;
 }
 
-bool IsPointInsidePolygon(const vector<Triangle> *triangles, const XY *point) {
-	for (vector<Triangle>::const_iterator it = triangles->begin(); it != triangles->end(); it++) {
-		if (IsPointInTriangle(point, it->getXY(0), it->getXY(1), it->getXY(2))) {
-			return true;
-		}
-	}
-	return false;
-}
+#define TREES_PER_UNIT 2300		//trees are in grid with cells of 1/TREES_PER_UNIT degree
+#define TREE_JITTER_MARGIN 0.1		//tree is moved randomly in its cell, but not closer to border of cell
 
-//Function returns set of points inside of multipolygon
-// This function is VERY slow (and bad) - try it on big forest and speed it up!
-void ComputeRegularInsidePoints(const vector<Triangle> *triangles, vector<PointFieldItem*> *output_objects, PointField *point_field, size_t tree_style_min, size_t tree_style_max) {
+//Function returns trees inside of multipolygon (given by its triangles) and inside of rect. Trees are in grid of world
+//coordinates, one tree in every cell, moved randomly by hash of cell and seed (id of forest). So the same forest has
+//the same trees in every tile, seams of tiles match and only trees in rect are computed.
+void ComputeRegularInsidePoints(const vector<Triangle> *triangles, vector<PointFieldItem*> *output_objects, const PointField *point_field, uint64_t seed, const Rect &rect, size_t tree_style_min, size_t tree_style_max) {
 	assert(tree_style_min <= tree_style_max);
 
-	if (triangles->empty()) return;
-
-								//determining area of interest from outer polygon
-	double minlat = 1000, minlon = 1000, maxlat = -1000, maxlon = -1000;
+	set<pair<int64_t,int64_t> > used_cells;		//point on edge shared by two triangles is inside of both of them
 	for (vector<Triangle>::const_iterator it = triangles->begin(); it != triangles->end(); it++) {
-		for (size_t i = 0; i < 3; i++) {
-			if (it->points[i]->x < minlon) minlon = it->points[i]->x;
-			if (it->points[i]->x > maxlon) maxlon = it->points[i]->x;
-			if (it->points[i]->y < minlat) minlat = it->points[i]->y;
-			if (it->points[i]->y > maxlat) maxlat = it->points[i]->y;
-		}
-	}
-
-	const double TREES_PER_UNIT = 3000;
-
-	size_t occuped_length = ceil((maxlon-minlon)*TREES_PER_UNIT + 1);
-	double *occuped = new double[occuped_length+1];
-	for (size_t i = 0; i <= occuped_length; i++) occuped[i] = 0;
-
-	double y_step = (1 / TREES_PER_UNIT) / occuped_length;
-	//cout << "Kroků: " << (maxlat-minlat)/y_step << endl;
-
-	XY *xy = new XY();
-	for (double current_y = minlat; current_y <= maxlat; current_y += y_step) {
-		double relative = (rand() % (occuped_length*1000)) / 1000.0;
-		size_t pos_x = static_cast<size_t>(floor(relative));
-		double weight_right = relative - pos_x;
-		double occuped_now = occuped[pos_x] * (1 - weight_right);
-		occuped_now += occuped[pos_x+1] * weight_right;
-
-		if (occuped_now < 0.3 && occuped_now * 1000 < rand()%1000) {
-			xy->x = (relative / occuped_length) * (maxlon-minlon) + minlon;
-			xy->y = current_y;
-			if (!point_field->isPointNearOther(xy->x, xy->y)) {
-				occuped[pos_x] += 1 - weight_right;
-				occuped[pos_x+1] += weight_right;
-
-				if (IsPointInsidePolygon(triangles, xy)) {
-					PointFieldItem *point = new PointFieldItem();
-					point->item_type = (rand() % (tree_style_max - tree_style_min + 1)) + tree_style_min;
-					point->xy = xy;
-					output_objects->push_back(point);
-					xy = new XY();
-				}
-			}
-		}
-
-		for (size_t i = 0; i <= occuped_length; i++) {
-			if (occuped[i] > 0) {
-				occuped[i] -= y_step * TREES_PER_UNIT;
-				if (occuped[i] < 0) occuped[i] = 0;
+		//only cells in bounding box of triangle are checked
+		const double minx = max(min(min(it->getX(0), it->getX(1)), it->getX(2)), rect.minlon);
+		const double maxx = min(max(max(it->getX(0), it->getX(1)), it->getX(2)), rect.maxlon);
+		const double miny = max(min(min(it->getY(0), it->getY(1)), it->getY(2)), rect.minlat);
+		const double maxy = min(max(max(it->getY(0), it->getY(1)), it->getY(2)), rect.maxlat);
+		if (minx > maxx || miny > maxy) continue;
+
+		const int64_t min_cell_x = floor(minx * TREES_PER_UNIT), max_cell_x = floor(maxx * TREES_PER_UNIT);
+		const int64_t min_cell_y = floor(miny * TREES_PER_UNIT), max_cell_y = floor(maxy * TREES_PER_UNIT);
+		for (int64_t cell_y = min_cell_y; cell_y <= max_cell_y; cell_y++) {
+			for (int64_t cell_x = min_cell_x; cell_x <= max_cell_x; cell_x++) {
+				RandomGenerator random(seed, cell_x, cell_y);
+				XY xy((cell_x + TREE_JITTER_MARGIN + (1 - 2*TREE_JITTER_MARGIN) * random.nextBelow(1000)/1000.0) / TREES_PER_UNIT,
+				 (cell_y + TREE_JITTER_MARGIN + (1 - 2*TREE_JITTER_MARGIN) * random.nextBelow(1000)/1000.0) / TREES_PER_UNIT);
+				if (!rect.containsPoint(xy.y, xy.x)) continue;
+				if (!IsPointInTriangle(&xy, it->getXY(0), it->getXY(1), it->getXY(2))) continue;
+				if (point_field->isPointNearOther(xy.x, xy.y)) continue;
+				if (!used_cells.insert(make_pair(cell_x, cell_y)).second) continue;
+
+				PointFieldItem *point = new PointFieldItem();
+				point->item_type = random.nextBelow(tree_style_max - tree_style_min + 1) + tree_style_min;
+				point->xy = new XY(xy);
+				output_objects->push_back(point);
 			}
 		}
 	}
-
-	delete xy;
-	delete[] occuped;
 }
 
 void MultiPolygon::convertToTriangles(vector<Triangle> *triangles) const {
+	TraceSpan trace_span("feature", "triangulation", this->getId(), TRACE_MIN_FEATURE_SECONDS);
+
 	// At first, I sort nodes by X coord
 	Point *points;
 	{
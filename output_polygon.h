@@ -3,8 +3,7 @@
 
 class Polygon3D {
 	private:
-	string coords_output;
-	size_t points_count;
+	vector<double> points;		//x,y,z of each point without duplicates, every part is closed
 	bool is_valid;
 
 	bool addPart(uint64_t area_id, const vector<double> &coords);
@@ -13,8 +12,9 @@ class Polygon3D {
 	Polygon3D(uint64_t area_id, const vector<double> &coords);
 	bool isValidPolygon() const { return this->is_valid; }
 	void addHole(uint64_t area_id, const vector<double> &coords);
-	size_t getPointsCount() const { assert(this->is_valid); return this->points_count; }
-	string getCoordsOutput() const { assert(this->is_valid); return this->coords_output; }
+	size_t getPointsCount() const { assert(this->is_valid); return this->points.size()/3; }
+	const vector<double> &getPoints() const { assert(this->is_valid); return this->points; }
+	string getCoordsOutput() const;
 };
 
 class Way;
@@ -41,12 +41,33 @@ class Triangle {
 	const XY *getXY(size_t point_pos) const { return this->points[point_pos]; }
 };
 
+//Indexed triangle mesh in output coords, every triangle can have its own style
+class Mesh {
+	private:
+	vector<double> vertices;		//x,y,z of each vertex
+	vector<size_t> faces;			//indices of three vertices and index of style for each triangle
+	vector<const char*> styles;
+
+	public:
+	size_t addVertex(double x, double y, double z);
+	void addTriangle(size_t a, size_t b, size_t c, const char *style);
+	void addQuad(size_t a, size_t b, size_t c, size_t d, const char *style);
+	bool isEmpty() const { return this->faces.empty(); }
+	size_t getVerticesCount() const { return this->vertices.size()/3; }
+	size_t getTrianglesCount() const { return this->faces.size()/4; }
+	const vector<double> &getVertices() const { return this->vertices; }
+	const vector<size_t> &getFaces() const { return this->faces; }
+	const vector<const char*> &getStyles() const { return this->styles; }
+};
+
+void AddRibbonToMesh(const vector<XY> &line, double width, double height, const char *style, Mesh *mesh);
+
 struct PointFieldItem {
 	XY *xy;
 	size_t item_type;
 };
 
-void ComputeRegularInsidePoints(const vector<Triangle> *triangles, vector<PointFieldItem*> *output_objects, class PointField *point_field, size_t tree_style_min, size_t tree_style_max);
+void ComputeRegularInsidePoints(const vector<Triangle> *triangles, vector<PointFieldItem*> *output_objects, const class PointField *point_field, uint64_t seed, const class Rect &rect, size_t tree_style_min, size_t tree_style_max);
 
 class MultiPolygon {
 	private:
@@ -72,6 +93,7 @@ class MultiPolygon {
 	const char *getAttribute(const char *key) const;
 	bool hasAttribute(const char *key, const char *value) const;
 	uint64_t getId() const;
+	uint64_t getRelationId() const;
 	size_t getPointsCount() const;
 	void convertToTriangles(vector<Triangle> *triangles) const;
 };
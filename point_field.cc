@@ -4,9 +4,20 @@
 #include "global.h"
 #include "point_field.h"
 
+#define CELL_SIZE 0.001		//in degrees; bigger than distance around common points
+
+static int64_t GetCellCoord(double coord) {
+	return static_cast<int64_t>(floor(coord / CELL_SIZE));
+}
+
+static uint64_t GetCellKey(int64_t cell_x, int64_t cell_y) {
+	return (static_cast<uint64_t>(static_cast<uint32_t>(cell_x)) << 32) | static_cast<uint32_t>(cell_y);
+}
+
 void PointField::addPoint(double x, double y, double distance) {
-	distance /= 2000;
-	this->field[x].insert(make_pair(y, distance));	//TODO magic constant, unify units!
+	distance /= 2000;	//TODO magic constant, unify units!
+	const Point point = { x, y, distance };
+	this->cells[GetCellKey(GetCellCoord(x), GetCellCoord(y))].push_back(point);
 
 	if (distance > this->max_used_distance)
 		this->max_used_distance = distance;
@@ -40,19 +51,20 @@ void PointField::addPointsInDistance(double x_from_excluding, double y_from_excl
 }
 
 bool PointField::isPointNearOther(double x, double y) const {
-	for (map<double,map<double,double> >::const_iterator x_it = this->field.lower_bound(x - this->max_used_distance); x_it != this->field.end(); x_it++) {
-		double x_delta = x_it->first - x;
-		if (x_delta > this->max_used_distance) break;
+	const int64_t min_cell_x = GetCellCoord(x - this->max_used_distance), max_cell_x = GetCellCoord(x + this->max_used_distance);
+	const int64_t min_cell_y = GetCellCoord(y - this->max_used_distance), max_cell_y = GetCellCoord(y + this->max_used_distance);
+	for (int64_t cell_x = min_cell_x; cell_x <= max_cell_x; cell_x++) {
+		for (int64_t cell_y = min_cell_y; cell_y <= max_cell_y; cell_y++) {
+			unordered_map<uint64_t,vector<Point> >::const_iterator cell_it = this->cells.find(GetCellKey(cell_x, cell_y));
+			if (cell_it == this->cells.end()) continue;
 
-		for (map<double,double>::const_iterator y_it = x_it->second.lower_bound(y - this->max_used_distance); y_it != x_it->second.end(); y_it++) {
-			double y_delta = y_it->first - y;
-			if (y_delta > this->max_used_distance) break;
-
-			if (sqrt(x_delta*x_delta + y_delta*y_delta) <= y_it->second) {
-				return true;
+			for (vector<Point>::const_iterator it = cell_it->second.begin(); it != cell_it->second.end(); it++) {
+				const double x_delta = it->x - x, y_delta = it->y - y;
+				if (sqrt(x_delta*x_delta + y_delta*y_delta) <= it->distance) {
+					return true;
+				}
 			}
 		}
-
 	}
 
 	return false;
@@ -1,9 +1,15 @@
-
 #pragma once
 
+//Points (with distance around them) which other objects avoid, e.g. trees aren't placed on ways and buildings.
+//Points are kept in square cells of a grid, so a query reads only a few cells around the point. Queries don't
+//change the field, so they can run from more threads at once while no point is added.
 class PointField {
 	private:
-	map<double,map<double,double> > field;
+	struct Point {
+		double x, y, distance;
+	};
+
+	unordered_map<uint64_t,vector<Point> > cells;		//key is made from cell coords, see GetCellKey()
 	double max_used_distance;
 
 	public:
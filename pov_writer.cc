@@ -2,33 +2,13 @@
 #include "global.h"
 #include "output_polygon.h"
 #include "pov_writer.h"
+#include "diagnostics.h"
 #include "primitives.h"
+#include "trace.h"
 
 
-double metres2unit(double metres) {
-	return metres / 60;
-}
-
-PovWriter::PovWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square) {
-	this->view_rect = view_rect;
-
-	if (fix_size_to_square) {			//fix coords to make area square
-		const double weighted_lat_diff = (this->view_rect.maxlat - this->view_rect.minlat)/LAT_WEIGHT;
-		const double weighted_lon_diff = (this->view_rect.maxlon - this->view_rect.minlon)/LON_WEIGHT;
-		if (weighted_lat_diff > weighted_lon_diff) {
-			const double lon_center = (this->view_rect.minlon + this->view_rect.maxlon)/2;
-			const double new_diff_to_center = (lon_center-this->view_rect.minlon)*(weighted_lat_diff/weighted_lon_diff);
-			this->view_rect.minlon = lon_center - new_diff_to_center;
-			this->view_rect.maxlon = lon_center + new_diff_to_center;
-		}
-		else {
-			const double lat_center = (this->view_rect.minlat + this->view_rect.maxlat)/2;
-			const double new_diff_to_center = (lat_center-this->view_rect.minlat)*(weighted_lon_diff/weighted_lat_diff);
-			this->view_rect.minlat = lat_center - new_diff_to_center;
-			this->view_rect.maxlat = lat_center + new_diff_to_center;
-		}
-	}
-
+PovWriter::PovWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom)
+ : SceneWriter(view_rect, fix_size_to_square, zoom), filename(filename), chunks_per_side(0), chunk_files(false), cost_model(NULL), write_cost_report(false) {
 	this->fs.open(filename);
 	if (!this->fs) {
 		cerr << "Cannot open " << filename << "!" << endl;
@@ -40,21 +20,121 @@ PovWriter::PovWriter(const char *filename, const Rect &view_rect, bool fix_size_
 	this->fs << "#version 3.7;" << endl;
 	this->fs << "global_settings {assumed_gamma 2.0}" << endl;
 	this->fs << "camera { orthographic location <0,0,-230> direction <0,0,13>";
-	this->fs << " up <0," << ((this->view_rect.maxlat-this->view_rect.minlat)*76.54/LAT_WEIGHT) << ",0>";
-	this->fs << " right <" << ((this->view_rect.maxlon-this->view_rect.minlon)*100/LON_WEIGHT) << ",0,0>";
+	this->fs << " up <0," << ((this->view_rect.maxlat-this->view_rect.minlat)*76.54/LAT_WEIGHT*this->zoom_scale) << ",0>";
+	this->fs << " right <" << ((this->view_rect.maxlon-this->view_rect.minlon)*100/LON_WEIGHT*this->zoom_scale) << ",0,0>";
 	this->fs << " look_at <0,0,0> translate <100,0,0> rotate <22.5,0,0> }" << endl;
 	this->fs << "#include \"osm2pov-styles.inc\"" << endl;
 }
 
 PovWriter::~PovWriter() {
-	if (this->fs) {
-		this->writeComment("End of file");
-		this->fs.close();
+	if (this->fs.is_open()) this->close();
+	for (vector<Chunk*>::iterator it = this->chunks.begin(); it != this->chunks.end(); it++) delete *it;
+}
+
+//writes chunks, end of file, its hash and cost report
+bool PovWriter::close() {
+	TraceSpan trace_span("writer", "flush");
+	bool success = this->writeChunks();
+	this->chunks_per_side = 0;		//rest of output goes directly to file
+	this->fs << " // End of file\n";		//also without comments, so it's seen that file is complete
+	this->fs.close();
+	if (!this->fs) {
+		cerr << "Cannot write " << this->filename << "!" << endl;
+		return false;
 	}
+	if (!WriteHashFile(this->filename.c_str(), this->fs.getHash())) success = false;
+	if (this->cost_model != NULL && this->write_cost_report && !this->cost_report.write(this->filename.c_str(), *this->cost_model)) success = false;
+	return success;
+}
+
+//Objects will be split by grid over view rectangle to chunks_per_side*chunks_per_side chunks. Every chunk is
+//written as union with tight bounding box, so POV-Ray gets good bounding hierarchy. When chunk_files is set, every
+//chunk is in separate include file (and it's possible to regenerate only some of them). Chunks are kept in memory
+//until the end, so only one chunk file is opened at once whatever the count of chunks is.
+void PovWriter::setChunks(size_t chunks_per_side, bool chunk_files) {
+	assert(this->chunks.empty());
+	this->chunks_per_side = chunks_per_side;
+	this->chunk_files = chunk_files;
+	this->chunks.resize(chunks_per_side*chunks_per_side, NULL);
+}
+
+//returns stream to which object with the bounds should be written
+ostream &PovWriter::getOutput(const Bounds &bounds) {
+	if (this->chunks_per_side == 0) return this->fs;
+
+	const double min_x = this->convertLonToCoord(this->view_rect.minlon), max_x = this->convertLonToCoord(this->view_rect.maxlon);
+	const double min_z = this->convertLatToCoord(this->view_rect.minlat), max_z = this->convertLatToCoord(this->view_rect.maxlat);
+	const double center_x = (bounds.min[0]+bounds.max[0])/2, center_z = (bounds.min[2]+bounds.max[2])/2;
+
+	int chunk_x = static_cast<int>(floor((center_x-min_x)/(max_x-min_x)*this->chunks_per_side));
+	int chunk_z = static_cast<int>(floor((center_z-min_z)/(max_z-min_z)*this->chunks_per_side));
+	if (chunk_x < 0) chunk_x = 0;			//objects in margin belong to border chunks
+	if (chunk_x >= (int)this->chunks_per_side) chunk_x = this->chunks_per_side-1;
+	if (chunk_z < 0) chunk_z = 0;
+	if (chunk_z >= (int)this->chunks_per_side) chunk_z = this->chunks_per_side-1;
+
+	Chunk *&chunk = this->chunks[chunk_z*this->chunks_per_side + chunk_x];
+	if (chunk == NULL) {
+		chunk = new Chunk();
+		if (this->chunk_files) {
+			stringstream s;
+			const size_t extension_pos = this->filename.rfind(".pov");
+			s << this->filename.substr(0, extension_pos) << "-chunk-" << chunk_x << "-" << chunk_z << ".inc";
+			chunk->filename = s.str();
+		}
+		chunk->output.precision(12);
+	}
+	chunk->bounds.addBounds(bounds);
+
+	if (!this->pending_comments.empty()) {
+		chunk->output << this->pending_comments;
+		this->pending_comments.clear();
+	}
+	return chunk->output;
+}
+
+//returns false when some chunk file couldn't be written
+bool PovWriter::writeChunks() {
+	bool success = true;
+	for (size_t i = 0; i < this->chunks.size(); i++) {
+		Chunk *chunk = this->chunks[i];
+		if (chunk == NULL) continue;
+
+		this->fs << "union {" << endl;
+		if (this->chunk_files) {
+			HashingOfstream file;
+			file.open(chunk->filename.c_str());
+			file << chunk->output.rdbuf();
+			file.close();
+			if (!file) {
+				cerr << "Cannot write " << chunk->filename << "!" << endl;
+				success = false;
+			}
+			//hash of chunk file is in main file, so hash of main file covers whole scene
+			this->fs << "#include \"" << chunk->filename << "\"\t// hash " << FormatHash(file.getHash()) << endl;
+		}
+		else this->fs << chunk->output.rdbuf();
+		this->fs << "bounded_by { box { <" << chunk->bounds.min[0] << "," << chunk->bounds.min[1] << "," << chunk->bounds.min[2] << ">, ";
+		this->fs << "<" << chunk->bounds.max[0] << "," << chunk->bounds.max[1] << "," << chunk->bounds.max[2] << "> } }" << endl;
+		this->fs << "}" << endl;
+	}
+	this->fs << this->pending_comments;
+	this->pending_comments.clear();
+	return success;
+}
+
+SceneCounters PovWriter::getCounters() const {
+	SceneCounters counters = this->counters;
+	counters.bytes = this->fs.getBytesWritten();
+	for (vector<Chunk*>::const_iterator it = this->chunks.begin(); it != this->chunks.end(); it++) {
+		if (*it != NULL) counters.bytes += max<streamoff>((*it)->output.tellp(), 0);
+	}
+	return counters;
 }
 
 void PovWriter::writeComment(const char *comment) {
-	this->fs << " // " << comment << endl;
+	if (this->chunks_per_side == 0) this->fs << " // " << comment << "\n";
+	else this->pending_comments += string(" // ") + comment + "\n";
 }
 
 void PovWriter::writeTriangle(uint64_t id, const Triangle &triangle, double height, const char *style) {
@@ -70,19 +150,25 @@ void PovWriter::writeTriangle(uint64_t id, const Triangle &triangle, double heig
 	for (size_t i = 0; i < 3; i++) {
 		if (x[i] <= x[(i+1)%3]+COMP_PRECISION && x[i] >= x[(i+1)%3]-COMP_PRECISION
 		 && y[i] <= y[(i+1)%3]+COMP_PRECISION && y[i] >= y[(i+1)%3]-COMP_PRECISION) {
-			cerr << "Skipping triangle in area with id " << id << "." << endl;
+			g_diagnostics.add(diagnostic_degenerated_triangle, id);
 			return;
 		}
 	}
 
-	this->fs << "triangle { ";
+	Bounds bounds;
+	for (size_t i = 0; i < 3; i++) bounds.addPoint(x[i], this->convertMetresToCoord(height), y[i]);
+	ostream &output = this->getOutput(bounds);
+	this->counters.triangles++;
+	if (this->cost_model != NULL) this->cost_report.addObjects(pov_triangle, style, 1, 3, 1);
+
+	output << "triangle { ";
 
 	for (size_t i = 0; i < 3; i++) {
-		this->fs << (i == 0 ? "<" : ",<") << x[i] << "," << metres2unit(height) << "," << y[i] << ">";
+		output << (i == 0 ? "<" : ",<") << x[i] << "," << this->convertMetresToCoord(height) << "," << y[i] << ">";
 	}
 
-	this->fs << " texture { " << style << " } ";
-	this->fs << "}" << endl;
+	output << " texture { " << style << " } ";
+	output << "}\n";
 }
 
 //When all polygons are decomposed into triangles. It is in most cases faster rendering
@@ -97,15 +183,26 @@ void PovWriter::writePolygon(uint64_t id, const vector<Triangle> &triangles, dou
 void PovWriter::writePolygon(const MultiPolygon &polygon, double height, const char *style) {
 	assert(polygon.isValid());
 
-	this->fs << "polygon { ";
-	this->fs << polygon.getPointsCount() << " ";
+	Bounds bounds;
+	{
+		const list<vector<XY> > &outer_parts = polygon.getOuterParts();
+		for (list<vector<XY> >::const_iterator it = outer_parts.begin(); it != outer_parts.end(); it++) {
+			for (vector<XY>::const_iterator it2 = it->begin(); it2 != it->end(); it2++) {
+				bounds.addPoint(this->convertLonToCoord(it2->x), this->convertMetresToCoord(height), this->convertLatToCoord(it2->y));
+			}
+		}
+	}
+	ostream &output = this->getOutput(bounds);
+
+	output << "polygon { ";
+	output << polygon.getPointsCount() << " ";
 
 	{
 		const list<vector<XY> > &outer_parts = polygon.getOuterParts();
 		bool first = true;
 		for (list<vector<XY> >::const_iterator it = outer_parts.begin(); it != outer_parts.end(); it++) {
 			for (vector<XY>::const_iterator it2 = it->begin(); it2 != it->end(); it2++) {
-				this->fs << (first ? "<" : ",<") << this->convertLonToCoord(it2->x) << "," << metres2unit(height) << "," << this->convertLatToCoord(it2->y) << ">";
+				output << (first ? "<" : ",<") << this->convertLonToCoord(it2->x) << "," << this->convertMetresToCoord(height) << "," << this->convertLatToCoord(it2->y) << ">";
 				first = false;
 			}
 		}
@@ -114,52 +211,155 @@ void PovWriter::writePolygon(const MultiPolygon &polygon, double height, const c
 		const list<vector<XY> > &holes = polygon.getHoles();
 		for (list<vector<XY> >::const_iterator it = holes.begin(); it != holes.end(); it++) {
 			for (vector<XY>::const_iterator it2 = it->begin(); it2 != it->end(); it2++) {
-				this->fs << ",<" << this->convertLonToCoord(it2->x) << "," << metres2unit(height) << "," << this->convertLatToCoord(it2->y) << ">";
+				output << ",<" << this->convertLonToCoord(it2->x) << "," << this->convertMetresToCoord(height) << "," << this->convertLatToCoord(it2->y) << ">";
 			}
 		}
 	}
 
-	this->fs << " texture { " << style << " } ";
-	this->fs << "}" << endl;
+	output << " texture { " << style << " } ";
+	output << "}\n";
 }
 
 void PovWriter::writePolygon(const Polygon3D &polygon, const char *style) {
 	if (!polygon.isValidPolygon()) return;
 
-	this->fs << "polygon { ";
-	this->fs << polygon.getPointsCount() << " ";
-	this->fs << polygon.getCoordsOutput();
-	this->fs << " texture { " << style << " } ";
-	this->fs << "}" << endl;
+	Bounds bounds;
+	const vector<double> &points = polygon.getPoints();
+	for (size_t i = 0; i < points.size(); i += 3) bounds.addPoint(points[i], points[i+1], points[i+2]);
+	ostream &output = this->getOutput(bounds);
+	this->counters.polygons++;
+	if (this->cost_model != NULL) this->cost_report.addObjects(pov_polygon, style, 1, polygon.getPointsCount(), 0);
+
+	output << "polygon { ";
+	output << polygon.getPointsCount() << " ";
+	output << polygon.getCoordsOutput();
+	output << " texture { " << style << " } ";
+	output << "}\n";
+}
+
+//Mesh is written as mesh2 with list of textures when it has more styles
+void PovWriter::writeMesh(const Mesh &mesh) {
+	if (mesh.isEmpty()) return;
+
+	const vector<double> &vertices = mesh.getVertices();
+	const vector<size_t> &faces = mesh.getFaces();
+	const vector<const char*> &styles = mesh.getStyles();
+
+	Bounds bounds;
+	for (size_t i = 0; i < vertices.size(); i += 3) bounds.addPoint(vertices[i], vertices[i+1], vertices[i+2]);
+	ostream &output = this->getOutput(bounds);
+	this->counters.triangles += mesh.getTrianglesCount();
+	if (this->cost_model != NULL) {		//mesh is counted with its first texture, triangles with their own textures
+		vector<size_t> style_triangles(styles.size(), 0);
+		for (size_t i = 0; i < faces.size(); i += 4) style_triangles[styles.size() > 1 ? faces[i+3] : 0]++;
+		for (size_t i = 0; i < styles.size(); i++) {
+			this->cost_report.addObjects(pov_mesh, styles[i], (i == 0 ? 1 : 0), (i == 0 ? mesh.getVerticesCount() : 0), style_triangles[i]);
+		}
+	}
+
+	output << "mesh2 { vertex_vectors { " << mesh.getVerticesCount();
+	for (size_t i = 0; i < vertices.size(); i += 3) {
+		output << ",<" << vertices[i] << "," << vertices[i+1] << "," << vertices[i+2] << ">";
+	}
+	output << " } ";
+	if (styles.size() > 1) {
+		output << "texture_list { " << styles.size();
+		for (size_t i = 0; i < styles.size(); i++) output << ", texture { " << styles[i] << " }";
+		output << " } ";
+	}
+	output << "face_indices { " << mesh.getTrianglesCount();
+	for (size_t i = 0; i < faces.size(); i += 4) {
+		output << ",<" << faces[i] << "," << faces[i+1] << "," << faces[i+2] << ">";
+		if (styles.size() > 1) output << "," << faces[i+3];
+	}
+	output << " } ";
+	if (styles.size() == 1) output << "texture { " << styles[0] << " } ";
+	output << "}\n";
 }
 
 void PovWriter::writeBox(double x, double y, double width, double height, double length, double angle, const char *style) {
-	this->fs << "box { ";
-	this->fs << "<0,0," << -(width/2) << ">, ";
-	this->fs << "<" << length << "," << height << "," << (width/2) << "> ";
-	this->fs << "texture { " << style << " } ";
-	this->fs << "rotate <0," << angle << ",0> ";
-	this->fs << "translate <" << x << ",0," << y << "> ";
-	this->fs << "}" << endl;
+	Bounds bounds;
+	{
+		const double sin_angle = sin(angle * M_PI / 180), cos_angle = cos(angle * M_PI / 180);
+		for (size_t i = 0; i < 4; i++) {		//rotate <0,angle,0> of box corners
+			const double box_x = (i & 1 ? length : 0), box_z = (i & 2 ? width/2 : -width/2);
+			bounds.addPoint(box_x*cos_angle + box_z*sin_angle + x, 0, -box_x*sin_angle + box_z*cos_angle + y);
+		}
+		bounds.addPoint(x, height, y);
+	}
+	ostream &output = this->getOutput(bounds);
+	this->counters.boxes++;
+	if (this->cost_model != NULL) this->cost_report.addObjects(pov_box, style, 1, 0, 0);
+
+	output << "box { ";
+	output << "<0,0," << -(width/2) << ">, ";
+	output << "<" << length << "," << height << "," << (width/2) << "> ";
+	output << "texture { " << style << " } ";
+	output << "rotate <0," << angle << ",0> ";
+	output << "translate <" << x << ",0," << y << "> ";
+	output << "}\n";
 }
 
 void PovWriter::writeCylinder(double x, double y, double radius, double height, const char *style) {
-	this->fs << "cylinder { ";
-	this->fs << "<0," << height << ",0>, ";
-	this->fs << "<0,-1,0>, ";		//-1 because when it has too small height, povray don't render it
-	this->fs << radius << " ";
-	this->fs << "texture { " << style << " } ";
-	this->fs << "translate <" << x << ",0," << y << "> ";
-	this->fs << "}" << endl;
+	Bounds bounds;
+	bounds.addPoint(x-radius, -1, y-radius);
+	bounds.addPoint(x+radius, height, y+radius);
+	ostream &output = this->getOutput(bounds);
+	this->counters.cylinders++;
+	if (this->cost_model != NULL) this->cost_report.addObjects(pov_cylinder, style, 1, 0, 0);
+
+	output << "cylinder { ";
+	output << "<0," << height << ",0>, ";
+	output << "<0,-1,0>, ";		//-1 because when it has too small height, povray don't render it
+	output << radius << " ";
+	output << "texture { " << style << " } ";
+	output << "translate <" << x << ",0," << y << "> ";
+	output << "}\n";
 }
 
-void PovWriter::writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale) {
-	this->fs << "plane { ";
+//Sprite objects are declared only once for every texture and scale and every sprite is only instance of them
+//(forests have hundreds of thousands of trees, so it saves lot of output and parsing time)
+const string &PovWriter::getSpriteDeclaration(const char *sprite_style, size_t sprite_style_number, double scale) {
+	stringstream style;
+	style << sprite_style << sprite_style_number;
+	const pair<string,double> key(style.str(), scale);
+
+	map<pair<string,double>,string>::const_iterator it = this->sprite_declarations.find(key);
+	if (it != this->sprite_declarations.end()) return it->second;
+
+	stringstream name;
+	name << "sprite_" << style.str();
+	size_t same_style_count = 0;
+	for (it = this->sprite_declarations.begin(); it != this->sprite_declarations.end(); it++) {
+		if (it->first.first == key.first) same_style_count++;
+	}
+	if (same_style_count > 0) name << "_" << (same_style_count+1);
+
+	this->fs << "#declare " << name.str() << " = plane { ";
 	this->fs << "z, 0 hollow on clipped_by { box { <0,0,-1>, <1,1,1> } } ";
-	this->fs << "texture { " << sprite_style << sprite_style_number << " } ";
+	this->fs << "texture { " << style.str() << " } ";
 	this->fs << "translate <-0.5,0,0> ";
 	this->fs << "scale " << scale << " ";
-	this->fs << "translate <" << (this->convertLonToCoord(x)) << ", 0, " << this->convertLatToCoord(y) << ">";
-	this->fs << "}" << endl;
+	this->fs << "}\n";
+
+	return (this->sprite_declarations[key] = name.str());
 }
 
+void PovWriter::writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale) {
+	scale *= this->zoom_scale;
+	const string &declaration = this->getSpriteDeclaration(sprite_style, sprite_style_number, scale);
+	const double coord_x = this->convertLonToCoord(x), coord_y = this->convertLatToCoord(y);
+
+	Bounds bounds;
+	bounds.addPoint(coord_x-scale/2, 0, coord_y-scale);
+	bounds.addPoint(coord_x+scale/2, scale, coord_y+scale);
+	ostream &output = this->getOutput(bounds);
+	this->counters.sprites++;
+	if (this->cost_model != NULL) {
+		stringstream style;
+		style << sprite_style << sprite_style_number;
+		this->cost_report.addObjects(pov_sprite, style.str().c_str(), 1, 0, 0);
+	}
+
+	output << "object { " << declaration << " translate <" << coord_x << ",0," << coord_y << "> }\n";
+}
@@ -1,37 +1,74 @@
-
 #pragma once
 
-#define LAT_WEIGHT 0.1138
-#define LON_WEIGHT 0.0878
-
-#include "primitives.h"
+#include "scene_writer.h"
+#include "hash_stream.h"
+#include "render_cost.h"
 
-class PovWriter {
+class PovWriter : public SceneWriter {
 	private:
-	ofstream fs;
-	Rect view_rect;			 //visible rectangle
+	struct Bounds {
+		double min[3], max[3];
+
+		Bounds() {
+			this->min[0] = this->min[1] = this->min[2] = 1e100;
+			this->max[0] = this->max[1] = this->max[2] = -1e100;
+		}
+		void addPoint(double x, double y, double z) {
+			const double point[3] = { x, y, z };
+			for (size_t i = 0; i < 3; i++) {
+				if (point[i] < this->min[i]) this->min[i] = point[i];
+				if (point[i] > this->max[i]) this->max[i] = point[i];
+			}
+		}
+		void addBounds(const Bounds &bounds) {
+			this->addPoint(bounds.min[0], bounds.min[1], bounds.min[2]);
+			this->addPoint(bounds.max[0], bounds.max[1], bounds.max[2]);
+		}
+	};
+
+	//part of scene in one cell of grid over view rectangle; written as one union at end of file (or to its own file)
+	struct Chunk {
+		stringstream output;
+		string filename;		//when chunks are written into separate files
+		Bounds bounds;
+	};
+
+	HashingOfstream fs;
+	string filename;
+	map<pair<string,double>,string> sprite_declarations;		//sprite style and scale -> name of declared object
+	size_t chunks_per_side;			//0 means objects are written directly to file, not to chunks
+	bool chunk_files;
+	vector<Chunk*> chunks;
+	string pending_comments;		//comments before next object (only when chunks are used)
+	const RenderCostModel *cost_model;		//NULL when cost isn't estimated
+	bool write_cost_report;		//OUTPUT.cost is written (see --cost-report)
+	RenderCostReport cost_report;
+
+	ostream &getOutput(const Bounds &bounds);
+	bool writeChunks();
+	const string &getSpriteDeclaration(const char *sprite_style, size_t sprite_style_number, double scale);
+	void writeTriangle(uint64_t id, const Triangle &triangle, double height, const char *style);
 
 	public:
-	PovWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square);
+	PovWriter(const char *filename, const Rect &view_rect, bool fix_size_to_square, int zoom);
 	~PovWriter();
 	bool isOpened() const {
 		return (this->fs.is_open());
 	}
+	bool close();
+	void setChunks(size_t chunks_per_side, bool chunk_files);
+	void setCostModel(const RenderCostModel *cost_model, bool write_cost_report) {
+		this->cost_model = cost_model;
+		this->write_cost_report = write_cost_report;
+	}
+	double getCost() const { return (this->cost_model != NULL ? this->cost_report.getCost(*this->cost_model) : 0); }
+	SceneCounters getCounters() const;
 	void writeComment(const char *comment);
-	void writeTriangle(uint64_t id, const Triangle &triangle, double height, const char *style);
 	void writePolygon(uint64_t id, const vector<Triangle> &triangles, double height, const char *style);
 	void writePolygon(const MultiPolygon &polygon, double height, const char *style);
 	void writePolygon(const Polygon3D &polygon, const char *style);
+	void writeMesh(const Mesh &mesh);
 	void writeBox(double x, double y, double width, double height, double length, double angle, const char *style);
 	void writeCylinder(double x, double y, double radius, double height, const char *style);
 	void writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale);
-
-	double convertLatToCoord(double lat) const {
-		return (lat - (this->view_rect.minlat+this->view_rect.maxlat)/2) / LAT_WEIGHT * 100 * 2;
-	}
-	double convertLonToCoord(double lon) const {
-		return (lon - (this->view_rect.minlon+this->view_rect.maxlon)/2) / LON_WEIGHT * 100 + 100;
-	}
 };
-
-double metres2unit(double metres);
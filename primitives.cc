@@ -4,11 +4,18 @@
 #include "global.h"
 #include "output_polygon.h"
 #include "primitives.h"
+#include "diagnostics.h"
+#include "feature_cache.h"
+#include "node_store.h"
+#include "task_pool.h"
 
 
 Primitives::Primitives() {
 	this->bounds_set = false;
 	this->bounds_set_by_x_y = false;
+	this->zoom = DEFAULT_ZOOM;
+	this->node_store = NULL;
+	this->views_count = 0;
 }
 
 Primitives::~Primitives() {
@@ -21,6 +28,125 @@ Primitives::~Primitives() {
 	for (unordered_map<uint64_t,Relation*>::iterator it = this->relations.begin(); it != this->relations.end(); it++) {
 		delete it->second;
 	}
+	for (unordered_map<uint64_t,Node*>::iterator it = this->stored_nodes.begin(); it != this->stored_nodes.end(); it++) {
+		delete it->second;
+	}
+	delete this->node_store;
+}
+
+//Locations of all nodes loaded from XML are saved to file and only nodes with tags are kept in memory, so much bigger
+//input can be loaded. Other nodes are created when some way needs them (see Way::getNodes()).
+bool Primitives::useNodeStore(const char *filename) {
+	this->node_store = new NodeStore();
+	return this->node_store->open(filename);
+}
+
+//with node store, location of node is saved to it and node without tags is removed from memory
+bool Primitives::finishNode(Node *node) {
+	if (this->node_store == NULL) return true;
+	if (!this->node_store->setLocation(node->getId(), node->getLat(), node->getLon())) return false;
+	if (node->getAttributes().empty()) {
+		this->nodes.erase(node->getId());
+		delete node;
+	}
+	return true;
+}
+
+bool Primitives::isNodeStored(uint64_t id) const {
+	return this->node_store->hasLocation(id);
+}
+
+//node without tags, which isn't kept in memory (see finishNode()), is created again from node store and kept, it's used
+//for node members of relations
+Node *Primitives::getNodeFromStore(uint64_t id) {
+	Node *node = this->getNode(id);
+	if (node != NULL || this->node_store == NULL) return node;
+
+	float lat, lon;
+	if (!this->node_store->getLocation(id, &lat, &lon)) return NULL;
+	node = new Node(id, lat, lon);
+	this->addNode(id, node);
+	return node;
+}
+
+//stored_nodes_lock must be locked
+const Node *Primitives::getStoredNode(uint64_t id) const {
+	const Node *node = this->getNode(id);
+	if (node != NULL) return node;
+
+	unordered_map<uint64_t,Node*>::const_iterator it = this->stored_nodes.find(id);
+	if (it != this->stored_nodes.end()) return it->second;
+
+	float lat, lon;
+	if (!this->node_store->getLocation(id, &lat, &lon)) return NULL;
+	Node *stored_node = new Node(id, lat, lon);
+	this->stored_nodes[id] = stored_node;
+	return stored_node;
+}
+
+//nodes from node store are created when way needs them first time (it can be called from more threads at once)
+void Way::resolveStoredNodes() const {
+	lock_guard<mutex> guard(this->node_source->stored_nodes_lock);
+	if (this->stored_nodes_resolved.load(memory_order_relaxed)) return;		//resolved by other thread meanwhile
+
+	for (vector<uint64_t>::const_iterator it = this->stored_node_ids.begin(); it != this->stored_node_ids.end(); it++) {
+		const Node *node = this->node_source->getStoredNode(*it);
+		if (node != NULL) this->nodes.push_back(node);
+	}
+	this->stored_nodes_resolved.store(true, memory_order_release);
+}
+
+void Primitives::addView() const {
+	lock_guard<mutex> guard(this->stored_nodes_lock);
+	this->views_count++;
+}
+
+void Primitives::removeView() const {
+	lock_guard<mutex> guard(this->stored_nodes_lock);
+	this->views_count--;
+	if (this->views_count == 0 && !this->stored_nodes.empty()) {
+		this->releaseStoredNodes();
+		this->stored_nodes_released.notify_all();
+	}
+}
+
+//Nodes created from node store are deleted when no view can use them, so they don't grow to all nodes in batch and
+//daemon mode. Ways create them again when they need them. stored_nodes_lock must be locked.
+void Primitives::releaseStoredNodes() const {
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+		Way &way = *it->second;
+		if (way.stored_node_ids.empty() || !way.stored_nodes_resolved.load(memory_order_relaxed)) continue;
+		vector<const Node*>().swap(way.nodes);
+		way.stored_nodes_resolved.store(false, memory_order_relaxed);
+	}
+	for (unordered_map<uint64_t,Node*>::iterator it = this->stored_nodes.begin(); it != this->stored_nodes.end(); it++) {
+		delete it->second;
+	}
+	unordered_map<uint64_t,Node*>().swap(this->stored_nodes);
+}
+
+//Waits until there are at most max_count nodes created from node store, they're released when all views end. It must not
+//be called from task of TaskPool (the task could wait for itself).
+void Primitives::waitForStoredNodesLimit(size_t max_count) const {
+	unique_lock<mutex> guard(this->stored_nodes_lock);
+	while (this->stored_nodes.size() > max_count) {
+		if (this->views_count == 0) this->releaseStoredNodes();		//nodes created without view
+		else this->stored_nodes_released.wait(guard);
+	}
+}
+
+Rect Way::getStoredNodesBounds() const {
+	const NodeStore &node_store = *this->node_source->node_store;
+	Rect bounds;
+	for (vector<uint64_t>::const_iterator it = this->stored_node_ids.begin(); it != this->stored_node_ids.end(); it++) {
+		float lat, lon;
+		node_store.getLocation(*it, &lat, &lon);
+		if (it == this->stored_node_ids.begin() || lat < bounds.minlat) bounds.minlat = lat;
+		if (it == this->stored_node_ids.begin() || lat > bounds.maxlat) bounds.maxlat = lat;
+		if (it == this->stored_node_ids.begin() || lon < bounds.minlon) bounds.minlon = lon;
+		if (it == this->stored_node_ids.begin() || lon > bounds.maxlon) bounds.maxlon = lon;
+	}
+	return bounds;
 }
 
 void Primitives::setInterestRectByViewRect() {
@@ -28,12 +154,32 @@ void Primitives::setInterestRectByViewRect() {
     this->interest_rect.enlargeByPercent(5);
 }
 
-void Primitives::setBoundsByXY(int tile_x, int tile_y) {
+Rect Primitives::getTileRect(int tile_x, int tile_y, int zoom) {
+	Rect rect;
+	rect.minlat = halftiley2lat(tile_y+1, zoom);
+	rect.maxlat = halftiley2lat(tile_y, zoom);
+	rect.minlon = tilex2lon(tile_x, zoom);
+	rect.maxlon = tilex2lon(tile_x+1, zoom);
+	return rect;
+}
+
+//tiles of default zoom whose interest rectangle (see setInterestRectByViewRect()) intersects rect
+void Primitives::getTilesInRect(const Rect &rect, set<pair<int,int> > *tiles) {
+	const int min_x = static_cast<int>(floor(lon2tilex(rect.minlon, DEFAULT_ZOOM))) - 1, max_x = static_cast<int>(floor(lon2tilex(rect.maxlon, DEFAULT_ZOOM))) + 1;
+	const int min_y = static_cast<int>(floor(lat2tiley(rect.maxlat, DEFAULT_ZOOM)/2)) - 1, max_y = static_cast<int>(floor(lat2tiley(rect.minlat, DEFAULT_ZOOM)/2)) + 1;
+	for (int y = min_y; y <= max_y; y++) {
+		for (int x = min_x; x <= max_x; x++) {
+			Rect tile_rect = getTileRect(x, y, DEFAULT_ZOOM);
+			tile_rect.enlargeByPercent(5);
+			if (tile_rect.intersects(rect)) tiles->insert(make_pair(x, y));
+		}
+	}
+}
+
+void Primitives::setBoundsByXY(int tile_x, int tile_y, int zoom) {
 	this->bounds_set_by_x_y = true;
-	this->view_rect.minlat = this->halftiley2lat(tile_y+1, 12);
-	this->view_rect.maxlat = this->halftiley2lat(tile_y, 12);
-	this->view_rect.minlon = this->tilex2lon(tile_x, 12);
-	this->view_rect.maxlon = this->tilex2lon(tile_x+1, 12);
+	this->zoom = zoom;
+	this->view_rect = getTileRect(tile_x, tile_y, zoom);
 
 	this->setInterestRectByViewRect();
 }
@@ -55,7 +201,7 @@ void Primitives::setLightlyIgnoredAttribute(const char *key, const char *value)
 
 bool Primitives::isAttributeLightlyIgnored(const char *key, const char *value) const {
 	unordered_map<string,const char*>::const_iterator it = this->lightly_ignored_attributes.find(key);
-	if (it == this->ignored_attributes.end()) return false;
+	if (it == this->lightly_ignored_attributes.end()) return false;
 	else if (value == NULL || it->second == NULL || strcmp(it->second,value) == 0) return true;
 	else return false;
 }
@@ -77,67 +223,128 @@ void Primitives::setBounds(double minlat, double minlon, double maxlat, double m
     this->setInterestRectByViewRect();
 }
 
-void Primitives::getNodesWithAttribute(list<const Node*> *output, const char *key, const char *value) {
-	for (unordered_map<uint64_t,Node*>::const_iterator it = this->nodes.begin(); it != this->nodes.end(); it++) {
+void Primitives::setAttributesUsed(const unordered_set<string> &used_attributes) {
+	for (unordered_set<string>::const_iterator it = used_attributes.begin(); it != used_attributes.end(); it++) {
+		this->disused_attributes.erase(*it);
+	}
+}
+
+void Primitives::getDisusedAttributes(multimap<size_t,string> *output) const {
+	for (unordered_map<string,size_t>::const_iterator it = this->disused_attributes.begin(); it != this->disused_attributes.end(); it++) {
+		output->insert(make_pair(it->second, it->first));
+	}
+}
+
+PrimitivesView::PrimitivesView(const Primitives &primitives)
+ : primitives(primitives), only_in_interest_rect(false), view_rect(primitives.getViewRect()), interest_rect(primitives.getInterestRect()),
+ zoom(primitives.getZoom()), task_pool(NULL), scanned_count(0), matched_count(0) {
+	primitives.addView();
+}
+
+PrimitivesView::~PrimitivesView() {
+	this->primitives.removeView();
+}
+
+void PrimitivesView::setBoundsByXY(int tile_x, int tile_y, int zoom) {
+	this->zoom = zoom;
+	this->view_rect = Primitives::getTileRect(tile_x, tile_y, zoom);
+	this->interest_rect = this->view_rect;
+	this->interest_rect.enlargeByPercent(5);
+}
+
+//relation is in interest rectangle when any of its ways is in it
+bool PrimitivesView::isRelationInInterestRect(const Relation &relation) const {
+	const vector<const PrimitiveRole*> &members = relation.getRelationMembers();
+	for (vector<const PrimitiveRole*>::const_iterator it = members.begin(); it != members.end(); it++) {
+		const Way *way = dynamic_cast<const Way*>(&(*it)->primitive);
+		if (way != NULL && way->isInRect(this->interest_rect)) return true;
+	}
+	return false;
+}
+
+void PrimitivesView::setAttributeUsed(const char *key, const char *value) {
+	if (value != NULL) this->used_attributes.insert(string(key)+"="+value);
+}
+
+//results of queries are sorted by id, so output doesn't depend on order of objects in hash tables
+static bool IsPrimitiveIdLower(const Primitive *a, const Primitive *b) {
+	return (a->getId() < b->getId());
+}
+
+static bool IsMultiPolygonIdLower(const MultiPolygon *a, const MultiPolygon *b) {
+	if (a->getId() != b->getId()) return (a->getId() < b->getId());
+	return (a->getRelationId() < b->getRelationId());
+}
+
+void PrimitivesView::getNodesWithAttribute(list<const Node*> *output, const char *key, const char *value) {
+	for (unordered_map<uint64_t,Node*>::const_iterator it = this->primitives.nodes.begin(); it != this->primitives.nodes.end(); it++) {
 		const char *value_now = it->second->getAttribute(key);
 		if (value_now != NULL) {
+			if (this->only_in_interest_rect && !this->interest_rect.containsPoint(it->second->getLat(), it->second->getLon())) continue;
 			if (value == NULL || strcmp(value, value_now) == 0) output->push_back(it->second);
 		}
 	}
+	output->sort(IsPrimitiveIdLower);
 
-	unordered_map<string,size_t>::const_iterator it = this->disused_attributes.find(string(key)+"="+value);
-	if (it != this->disused_attributes.end()) this->disused_attributes.erase(it);
+	this->scanned_count += this->primitives.nodes.size();
+	this->matched_count += output->size();
+	this->setAttributeUsed(key, value);
 }
 
-void Primitives::getWaysWithAttribute(list<const Way*> *output, const char *key, const char *value) {
-	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+void PrimitivesView::getWaysWithAttribute(list<const Way*> *output, const char *key, const char *value) {
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->primitives.ways.begin(); it != this->primitives.ways.end(); it++) {
 		const char *value_now = it->second->getAttribute(key);
 		if (value_now != NULL) {
+			if (this->only_in_interest_rect && !it->second->isInRect(this->interest_rect)) continue;
 			if (value == NULL || strcmp(value, value_now) == 0) output->push_back(it->second);
 		}
 	}
+	output->sort(IsPrimitiveIdLower);
+
+	this->scanned_count += this->primitives.ways.size();
+	this->matched_count += output->size();
+	this->setAttributeUsed(key, value);
+}
 
-	unordered_map<string,size_t>::const_iterator it = this->disused_attributes.find(string(key)+"="+value);
-	if (it != this->disused_attributes.end()) this->disused_attributes.erase(it);
+void MultiPolygonSource::addToMultiPolygon(MultiPolygon *multipolygon) const {
+	for (vector<const Way*>::const_iterator it = this->outer_ways.begin(); it != this->outer_ways.end(); it++) multipolygon->addOuterPart(*it);
+	for (vector<const Way*>::const_iterator it = this->holes.begin(); it != this->holes.end(); it++) multipolygon->addHole(*it);
 }
 
-void Primitives::getMultiPolygonsWithAttribute(list<MultiPolygon*> *output, const char *key, const char *value) {
+//Relations and closed ways with the attribute, every multipolygon only once; they aren't assembled yet
+void PrimitivesView::getMultiPolygonSources(vector<MultiPolygonSource> *output, const char *key, const char *value) {
 	unordered_set<uint64_t> ids_used_in_relations;
 
-	for (unordered_map<uint64_t,Relation*>::const_iterator it = this->relations.begin(); it != this->relations.end(); it++) {
+	for (unordered_map<uint64_t,Relation*>::const_iterator it = this->primitives.relations.begin(); it != this->primitives.relations.end(); it++) {
 		const char *value_now = it->second->getAttribute(key);
 		if (value_now != NULL && (value == NULL || strcmp(value, value_now) == 0)) {
-			MultiPolygon *multipolygon = new MultiPolygon(it->second, this->interest_rect);
+			if (this->only_in_interest_rect && !this->isRelationInInterestRect(*it->second)) continue;
+			MultiPolygonSource source(it->second, false);
 			const vector<const PrimitiveRole*> &members = it->second->getRelationMembers();
 
 			for (vector<const PrimitiveRole*>::const_iterator it2 = members.begin(); it2 != members.end(); it2++) {
 				if ((*it2)->role == "outer") {
 					const Way *way = dynamic_cast<const Way*>(&(*it2)->primitive);
-					if (way == NULL) cerr << "Primitive with id " << (*it2)->primitive.getId() << " has role=outer and isn't way, ignoring." << endl;
+					if (way == NULL) g_diagnostics.add(diagnostic_member_not_way, it->second->getId());
 					else {
-						multipolygon->addOuterPart(way);
+						source.outer_ways.push_back(way);
 						ids_used_in_relations.insert((*it2)->primitive.getId());
 					}
 				}
 				else if ((*it2)->role == "inner") {
 					const Way *way = dynamic_cast<const Way*>(&(*it2)->primitive);
-					if (way == NULL) cerr << "Primitive with id " << (*it2)->primitive.getId() << " has role=inner and isn't way, ignoring." << endl;
-					else multipolygon->addHole(way);
+					if (way == NULL) g_diagnostics.add(diagnostic_member_not_way, it->second->getId());
+					else source.holes.push_back(way);
 				}
 			}
 
-			if (!multipolygon->hasAnyOuterPart()) {
-				cerr << "Relation with id " << it->second->getId() << " hasn't any \"outer\" element, ignoring." << endl;
-				delete multipolygon;
-			}
-			else {
-				multipolygon->setDone();
-				if (multipolygon->isValid()) output->push_back(multipolygon);
-				else delete multipolygon;
+			if (source.outer_ways.empty()) {
+				g_diagnostics.add(diagnostic_without_outer, it->second->getId());
 			}
+			else output->push_back(source);
 		}
 	}
-	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->primitives.ways.begin(); it != this->primitives.ways.end(); it++) {
 		const char *value_now = it->second->getAttribute(key);
 		if (value_now != NULL && (value == NULL || strcmp(value, value_now) == 0)) {
 			const vector<const Relation*> &relations = it->second->getRelations();
@@ -148,27 +355,25 @@ void Primitives::getMultiPolygonsWithAttribute(list<MultiPolygon*> *output, cons
 					goto NEXT_WAY;			//is used in relation already
 				}
 				if (strcmp(role, "outer") == 0) {
-					MultiPolygon *multipolygon = new MultiPolygon(*it2, this->interest_rect);
+					if (this->only_in_interest_rect && !this->isRelationInInterestRect(**it2)) goto NEXT_WAY;
+					MultiPolygonSource source(*it2, true);
 					const vector<const PrimitiveRole*> &members = (*it2)->getRelationMembers();
 					for (vector<const PrimitiveRole*>::const_iterator it3 = members.begin(); it3 != members.end(); it3++) {
 						if ((*it3)->role == "outer") {		//exists more outer ways for this polygon
 							const Way *way = dynamic_cast<const Way*>(&(*it3)->primitive);
-							if (way == NULL) cerr << "Outer element other than way in relation " << (*it2)->getId() << ", ignoring." << endl;
+							if (way == NULL) g_diagnostics.add(diagnostic_member_not_way, (*it2)->getId());
 							else if ((*it3)->primitive.getId() < it->second->getId()) {		//I make it only once; when processing way with lowest id
-								delete multipolygon;
 								goto NEXT_WAY;
 							}
-							else multipolygon->addOuterPart(way);
+							else source.outer_ways.push_back(way);
 						}
 						else if ((*it3)->role == "inner") {
 							const Way *way = dynamic_cast<const Way*>(&(*it3)->primitive);
-							if (way == NULL) cerr << "Inner element other than way in relation " << (*it2)->getId() << ", ignoring." << endl;
-							else multipolygon->addHole(way);
+							if (way == NULL) g_diagnostics.add(diagnostic_member_not_way, (*it2)->getId());
+							else source.holes.push_back(way);
 						}
 					}
-					multipolygon->setDone();
-					if (multipolygon->hasAttribute(key, value) && multipolygon->isValid()) output->push_back(multipolygon);
-					else delete multipolygon;
+					output->push_back(source);
 					goto NEXT_WAY;
 				}
 				else if (strcmp(role, "inner") == 0) {
@@ -183,34 +388,74 @@ void Primitives::getMultiPolygonsWithAttribute(list<MultiPolygon*> *output, cons
 			}
 
 			//isn't in any relation, so add as common way
-			MultiPolygon *multipolygon = new MultiPolygon(NULL, this->interest_rect);
-			multipolygon->addOuterPart(it->second);
-			multipolygon->setDone();
-			if (multipolygon->isValid()) output->push_back(multipolygon);
-			else delete multipolygon;
+			if (this->only_in_interest_rect && !it->second->isInRect(this->interest_rect)) goto NEXT_WAY;
+			{
+				MultiPolygonSource source(NULL, false);
+				source.outer_ways.push_back(it->second);
+				output->push_back(source);
+			}
 		}
 		NEXT_WAY:;
 	}
 
-	if (value != NULL) {
-		unordered_map<string,size_t>::const_iterator it = this->disused_attributes.find(string(key)+"="+value);
-		if (it != this->disused_attributes.end()) this->disused_attributes.erase(it);
+	this->scanned_count += this->primitives.relations.size() + this->primitives.ways.size();
+	this->setAttributeUsed(key, value);
+}
+
+//Multipolygons are assembled from their ways (see MultiPolygon::setDone()) in parallel when task pool is set
+void PrimitivesView::getMultiPolygonsWithAttribute(list<MultiPolygon*> *output, const char *key, const char *value) {
+	vector<MultiPolygonSource> sources;
+	this->getMultiPolygonSources(&sources, key, value);
+	vector<MultiPolygon*> assembled(sources.size());
+	for (size_t i = 0; i < sources.size(); i++) {
+		assembled[i] = new MultiPolygon(sources[i].relation, this->interest_rect);
+		sources[i].addToMultiPolygon(assembled[i]);
+	}
+
+	ParallelFor(this->task_pool, assembled.size(), [&assembled](size_t i) {
+		assembled[i]->setDone();
+	});
+	for (size_t i = 0; i < assembled.size(); i++) {
+		if (assembled[i]->isValid() && (!sources[i].must_have_attribute || assembled[i]->hasAttribute(key, value))) output->push_back(assembled[i]);
+		else delete assembled[i];
 	}
+	output->sort(IsMultiPolygonIdLower);
+
+	this->matched_count += output->size();
 }
 
-void Primitives::getDisusedAttributes(multimap<size_t,string> *output) const {
-	for (unordered_map<string,size_t>::const_iterator it = this->disused_attributes.begin(); it != this->disused_attributes.end(); it++) {
-		output->insert(make_pair(it->second, it->first));
+static bool IsCachedAreaIdLower(const shared_ptr<CachedArea> &a, const shared_ptr<CachedArea> &b) {
+	return IsMultiPolygonIdLower(&a->getMultiPolygon(), &b->getMultiPolygon());
+}
+
+//Like getMultiPolygonsWithAttribute(), but multipolygons are taken from feature cache (and assembled and triangulated
+//only when other tile didn't do it yet). They aren't limited to interest rectangle and they are shared by all tiles.
+void PrimitivesView::getCachedAreasWithAttribute(vector<shared_ptr<CachedArea> > *output, const char *key, const char *value, FeatureCache *feature_cache) {
+	vector<MultiPolygonSource> sources;
+	this->getMultiPolygonSources(&sources, key, value);
+	vector<shared_ptr<CachedArea> > areas(sources.size());
+	for (size_t i = 0; i < sources.size(); i++) areas[i] = feature_cache->getArea(sources[i]);
+
+	ParallelFor(this->task_pool, areas.size(), [&areas](size_t i) {
+		areas[i]->assemble();
+	});
+	for (size_t i = 0; i < areas.size(); i++) {
+		const MultiPolygon &multipolygon = areas[i]->getMultiPolygon();
+		if (multipolygon.isValid() && (!sources[i].must_have_attribute || multipolygon.hasAttribute(key, value))) output->push_back(areas[i]);
 	}
+	stable_sort(output->begin(), output->end(), IsCachedAreaIdLower);
+
+	this->matched_count += output->size();
 }
 
 struct LoadXmlStruct {
 	Primitives &primitives;
 	Primitive *current_primitive;
 	bool current_primitive_is_deleted;
+	bool node_store_failed;
 
 	LoadXmlStruct(Primitives &primitives)
-	 : primitives(primitives), current_primitive(NULL), current_primitive_is_deleted(false) {
+	 : primitives(primitives), current_primitive(NULL), current_primitive_is_deleted(false), node_store_failed(false) {
 	}
 };
 
@@ -253,12 +498,14 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 	else if (strcmp(name, "way") == 0) {
 		uint64_t id;
 		bool id_set = false;
+		uint32_t version = 0;
 
 		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
 			if (strcmp(attributes[i], "id") == 0) {
 				id = atol(attributes[i+1]);
 				id_set = true;
 			}
+			else if (strcmp(attributes[i], "version") == 0) version = atol(attributes[i+1]);
 			else if (strcmp(attributes[i], "action") == 0 && strcmp(attributes[i+1], "delete") == 0) {
 				data->current_primitive_is_deleted = true;
 				return;
@@ -267,6 +514,7 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 
 		if (id_set) {
 			Way *way = new Way(id);
+			way->setVersion(version);
 			if (data->current_primitive != NULL || data->current_primitive_is_deleted)
 				cerr << "Way with id " << id << " is in other element!" << endl;
 			data->current_primitive = way;
@@ -277,12 +525,14 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 	else if (strcmp(name, "relation") == 0) {
 		uint64_t id;
 		bool id_set = false;
+		uint32_t version = 0;
 
 		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
 			if (strcmp(attributes[i], "id") == 0) {
 				id = atol(attributes[i+1]);
 				id_set = true;
 			}
+			else if (strcmp(attributes[i], "version") == 0) version = atol(attributes[i+1]);
 			else if (strcmp(attributes[i], "action") == 0 && strcmp(attributes[i+1], "delete") == 0) {
 				data->current_primitive_is_deleted = true;
 				return;
@@ -291,6 +541,7 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 
 		if (id_set) {
 			Relation *relation = new Relation(id);
+			relation->setVersion(version);
 			if (data->current_primitive != NULL || data->current_primitive_is_deleted)
 				cerr << "Relation with id " << id << " is in other element!" << endl;
 			data->current_primitive = relation;
@@ -331,7 +582,7 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 			cerr << "Element <nd> outside <way> tag!" << endl;
 		}
 		else {
-			uint64_t id;
+			uint64_t id = 0;
 			bool id_set = false;
 
 			for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
@@ -341,7 +592,11 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 				}
 			}
 
-			if (id_set) {
+			if (id_set && data->primitives.usesNodeStore()) {
+				if (data->primitives.isNodeStored(id))
+					dynamic_cast<Way*>(data->current_primitive)->addStoredNodeToWay(id, &data->primitives);
+			}
+			else if (id_set) {
 				const Node *node = data->primitives.getNode(id);
 				if (node == NULL) { } //it's ok cerr << "Node with id " << id << " isn't defined before defining way." << endl;
 				else dynamic_cast<Way*>(data->current_primitive)->addNodeToWay(node);
@@ -382,7 +637,7 @@ static void XmlStartElement(void *user_data, const char *name, const char **attr
 
 			if (is_way_set && member_id_set && role != NULL) {
 				Primitive *primitive;
-				if (!is_way) primitive = data->primitives.getNode(member_id);
+				if (!is_way) primitive = data->primitives.getNodeFromStore(member_id);
 				else {
 					primitive = data->primitives.getWay(member_id);
 					if (primitive != NULL)
@@ -445,7 +700,11 @@ static void XmlEndElement(void *user_data, const char *name) {
 			data->current_primitive_is_deleted = false;
 		else {
 			if (data->current_primitive == NULL) cerr << "Internal error in XML parser (closing of not-opened tag " << name << ")!" << endl;
-			else data->current_primitive = NULL;
+			else {
+				Node *node = dynamic_cast<Node*>(data->current_primitive);
+				if (node != NULL && !data->primitives.finishNode(node)) data->node_store_failed = true;
+				data->current_primitive = NULL;
+			}
 		}
 	}
 }
@@ -478,10 +737,165 @@ bool Primitives::loadFromXml(const char *filename) {
 	}
 
 	if (load_xml_struct.current_primitive != NULL) cerr << "Internal error in XML parser (not-closed tag)" << endl;
+	if (load_xml_struct.node_store_failed) success = false;
 
 	XML_ParserFree(parser);
 	fclose(fp);
 
+	return (this->finishLoading() && success);
+}
+
+//true when primitive has any tag which can be drawn (lightly ignored tags only specify other tags)
+bool Primitives::hasDrawnAttribute(const Primitive &primitive) const {
+	const unordered_map<string,string> &tags = primitive.getAttributes();
+	for (unordered_map<string,string>::const_iterator it = tags.begin(); it != tags.end(); it++) {
+		if (!this->isAttributeLightlyIgnored(it->first.c_str(), it->second.c_str())) return true;
+	}
+	return false;
+}
+
+//Removes primitives which can't be drawn: ways which aren't in any relation and have no drawn tag or are outside
+//keep_rect (NULL means whole area) and nodes which aren't used by remaining ways and relations and can't be drawn too.
+//Used when all tiles are known before drawing, so queries of (maybe parallel) written tiles don't scan them. It's done
+//only after the whole input is loaded (ways can be members of relations which come later).
+void Primitives::dropUnusedPrimitives(const Rect *keep_rect) {
+	size_t dropped_ways = 0, dropped_nodes = 0;
+
+	for (unordered_map<uint64_t,Way*>::iterator it = this->ways.begin(); it != this->ways.end(); ) {
+		const Way *way = it->second;
+		if (way->getRelations().empty() && (!this->hasDrawnAttribute(*way) || (keep_rect != NULL && !way->isInRect(*keep_rect)))) {
+			delete way;
+			it = this->ways.erase(it);
+			dropped_ways++;
+		}
+		else it++;
+	}
+
+	unordered_set<uint64_t> used_nodes;
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+		const vector<uint64_t> &stored_node_ids = it->second->getStoredNodeIds();
+		if (!stored_node_ids.empty()) {		//nodes from node store aren't created
+			used_nodes.insert(stored_node_ids.begin(), stored_node_ids.end());
+			continue;
+		}
+		const vector<const Node*> &nodes = it->second->getNodes();
+		for (vector<const Node*>::const_iterator it2 = nodes.begin(); it2 != nodes.end(); it2++) used_nodes.insert((*it2)->getId());
+	}
+	for (unordered_map<uint64_t,Relation*>::const_iterator it = this->relations.begin(); it != this->relations.end(); it++) {
+		const vector<const PrimitiveRole*> &members = it->second->getRelationMembers();
+		for (vector<const PrimitiveRole*>::const_iterator it2 = members.begin(); it2 != members.end(); it2++) {
+			const Node *node = dynamic_cast<const Node*>(&(*it2)->primitive);
+			if (node != NULL) used_nodes.insert(node->getId());
+		}
+	}
+
+	for (unordered_map<uint64_t,Node*>::iterator it = this->nodes.begin(); it != this->nodes.end(); ) {
+		const Node *node = it->second;
+		if (used_nodes.find(node->getId()) == used_nodes.end()
+		 && (!this->hasDrawnAttribute(*node) || (keep_rect != NULL && !keep_rect->containsPoint(node->getLat(), node->getLon())))) {
+			delete node;
+			it = this->nodes.erase(it);
+			dropped_nodes++;
+		}
+		else it++;
+	}
+
+	if (!g_quiet_mode) {
+		cout << "Dropped nodes: " << dropped_nodes << " Ways: " << dropped_ways << endl;
+	}
+}
+
+//Estimates of heap memory are for glibc malloc and libstdc++: every allocation has 8 bytes of header, it's aligned
+//to 16 bytes and it has at least 32 bytes; short strings (up to 15 chars) are stored inside string object.
+static uint64_t GetHeapBlockSize(size_t size) {
+	if (size == 0) return 0;
+	return max<uint64_t>(32, (size + 8 + 15) & ~static_cast<uint64_t>(15));
+}
+
+static uint64_t GetStringHeapSize(const string &str) {
+	return (str.capacity() > 15 ? GetHeapBlockSize(str.capacity()+1) : 0);
+}
+
+template<class T> static uint64_t GetVectorHeapSize(const vector<T> &items) {
+	return GetHeapBlockSize(items.capacity() * sizeof(T));
+}
+
+//buckets and nodes of table, node_size is size of allocated node (next pointer, item and maybe cached hash)
+template<class K, class V> static uint64_t GetHashTableHeapSize(const unordered_map<K,V> &table, size_t node_size) {
+	const uint64_t buckets_size = (table.bucket_count() > 1 ? GetHeapBlockSize(table.bucket_count() * sizeof(void*)) : 0);		//one bucket is inside table
+	return buckets_size + table.size() * GetHeapBlockSize(node_size);
+}
+
+static void AddTagsMemoryUsage(const Primitive &primitive, MemoryUsage *usage) {
+	const unordered_map<string,string> &tags = primitive.getAttributes();
+	usage->count += tags.size();
+	usage->bytes += GetHashTableHeapSize(tags, sizeof(void*) + sizeof(pair<const string,string>) + sizeof(size_t));		//hash of string is cached
+	for (unordered_map<string,string>::const_iterator it = tags.begin(); it != tags.end(); it++) {
+		usage->bytes += GetStringHeapSize(it->first) + GetStringHeapSize(it->second);
+	}
+}
+
+//Estimated memory of loaded data by kind of structures (for --stats). Nodes created from node store for ways are
+//counted as they are now, so the estimate depends on tiles written before.
+void Primitives::getMemoryUsage(vector<MemoryUsage> *output) const {
+	const size_t index_node_size = sizeof(void*) + sizeof(pair<const uint64_t,void*>);
+	MemoryUsage nodes = { "nodes", this->nodes.size(), this->nodes.size() * GetHeapBlockSize(sizeof(Node)), false };
+	MemoryUsage ways = { "ways", this->ways.size(), this->ways.size() * GetHeapBlockSize(sizeof(Way)), false };
+	MemoryUsage relations = { "relations", this->relations.size(), this->relations.size() * GetHeapBlockSize(sizeof(Relation)), false };
+	MemoryUsage tags = { "tags", 0, 0, false };
+	MemoryUsage way_nodes = { "way node pointers", 0, 0, false };
+	MemoryUsage way_stored_nodes = { "way stored node ids", 0, 0, false };
+	MemoryUsage way_relations = { "way relation pointers", 0, 0, false };
+	MemoryUsage members = { "relation members", 0, 0, false };
+	MemoryUsage indexes = { "id indexes", this->nodes.size() + this->ways.size() + this->relations.size(),
+	 GetHashTableHeapSize(this->nodes, index_node_size) + GetHashTableHeapSize(this->ways, index_node_size)
+	 + GetHashTableHeapSize(this->relations, index_node_size), false };
+
+	for (unordered_map<uint64_t,Node*>::const_iterator it = this->nodes.begin(); it != this->nodes.end(); it++) {
+		AddTagsMemoryUsage(*it->second, &tags);
+	}
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+		const Way &way = *it->second;
+		AddTagsMemoryUsage(way, &tags);
+		way_nodes.count += way.nodes.size();
+		way_nodes.bytes += GetVectorHeapSize(way.nodes);
+		way_stored_nodes.count += way.stored_node_ids.size();
+		way_stored_nodes.bytes += GetVectorHeapSize(way.stored_node_ids);
+		way_relations.count += way.relations.size();
+		way_relations.bytes += GetVectorHeapSize(way.relations);
+	}
+	for (unordered_map<uint64_t,Relation*>::const_iterator it = this->relations.begin(); it != this->relations.end(); it++) {
+		AddTagsMemoryUsage(*it->second, &tags);
+		const vector<const PrimitiveRole*> &relation_members = it->second->getRelationMembers();
+		members.count += relation_members.size();
+		members.bytes += GetVectorHeapSize(relation_members);
+		for (vector<const PrimitiveRole*>::const_iterator it2 = relation_members.begin(); it2 != relation_members.end(); it2++) {
+			members.bytes += GetHeapBlockSize(sizeof(PrimitiveRole)) + GetStringHeapSize((*it2)->role);
+		}
+	}
+
+	output->push_back(nodes);
+	output->push_back(ways);
+	output->push_back(relations);
+	output->push_back(tags);
+	output->push_back(way_nodes);
+	if (way_stored_nodes.count > 0) output->push_back(way_stored_nodes);
+	output->push_back(way_relations);
+	output->push_back(members);
+	output->push_back(indexes);
+
+	if (this->node_store != NULL) {
+		lock_guard<mutex> guard(this->stored_nodes_lock);
+		const MemoryUsage stored_nodes = { "nodes created from node store", this->stored_nodes.size(),
+		 this->stored_nodes.size() * GetHeapBlockSize(sizeof(Node)) + GetHashTableHeapSize(this->stored_nodes, index_node_size), false };
+		output->push_back(stored_nodes);
+		const MemoryUsage node_store = { "node store", this->node_store->getLocationsCount(), this->node_store->getMappedBytes(), true };
+		output->push_back(node_store);
+	}
+}
+
+//sets bounds when they aren't set yet and prints info about loaded data
+bool Primitives::finishLoading() {
 	if (!this->areBoundsSetByXY() && !this->areBoundsSetInFile()) {  //bounds are not set, so guess it from data
 		this->view_rect.minlat = 10000;			//some nonsens
 		this->view_rect.maxlat = -10000;
@@ -495,6 +909,13 @@ bool Primitives::loadFromXml(const char *filename) {
 			if (lon < this->view_rect.minlon) this->view_rect.minlon = lon;
 			if (lon > this->view_rect.maxlon) this->view_rect.maxlon = lon;
 		}
+		if (this->node_store != NULL && this->node_store->getLocationsCount() > 0) {
+			const Rect store_bounds = this->node_store->getBounds();
+			if (store_bounds.minlat < this->view_rect.minlat) this->view_rect.minlat = store_bounds.minlat;
+			if (store_bounds.maxlat > this->view_rect.maxlat) this->view_rect.maxlat = store_bounds.maxlat;
+			if (store_bounds.minlon < this->view_rect.minlon) this->view_rect.minlon = store_bounds.minlon;
+			if (store_bounds.maxlon > this->view_rect.maxlon) this->view_rect.maxlon = store_bounds.maxlon;
+		}
 
 		if (this->view_rect.minlat >= this->view_rect.maxlat || this->view_rect.minlon >= this->view_rect.maxlon) {
 			cerr << "Error while computing area bounds." << endl;
@@ -507,7 +928,8 @@ bool Primitives::loadFromXml(const char *filename) {
 	if (!g_quiet_mode) {
 		cout << "Area: LAT " << this->view_rect.minlat << " - " << this->view_rect.maxlat << ", LON " << this->view_rect.minlon << " - " << this->view_rect.maxlon << endl;
 		cout << "Nodes: " << this->nodes.size() << " Ways: " << this->ways.size() << " Relations: " << this->relations.size() << endl;
+		if (this->node_store != NULL) cout << "Nodes in node store: " << this->node_store->getLocationsCount() << endl;
 	}
 
-	return success;
+	return true;
 }
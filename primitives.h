@@ -1,7 +1,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #ifndef M_PI		//under Cygwin M_PI not found (??)
  #define M_PI 3.14159265358979323846
 #endif
@@ -21,6 +25,12 @@ struct Rect {
 		this->minlon -= lon_diff * percent/100;
 		this->maxlon += lon_diff * percent/100;
 	}
+	bool intersects(const Rect &other) const {
+		return (this->minlat <= other.maxlat && this->maxlat >= other.minlat && this->minlon <= other.maxlon && this->maxlon >= other.minlon);
+	}
+	bool containsPoint(double lat, double lon) const {
+		return (lat >= this->minlat && lat <= this->maxlat && lon >= this->minlon && lon <= this->maxlon);
+	}
 };
 
 class Primitive {
@@ -46,6 +56,12 @@ class Primitive {
 	void setAttribute(const char *key, const char *value) {
 		this->tags[key] = value;
 	}
+	const unordered_map<string,string> &getAttributes() const {
+		return this->tags;
+	}
+	void clearAttributes() {
+		this->tags.clear();
+	}
 };
 
 class Node : public Primitive {
@@ -58,32 +74,93 @@ class Node : public Primitive {
 	virtual ~Node() { }
 	const float getLat() const { return this->lat; }
 	const float getLon() const { return this->lon; }
+	void setPosition(float lat, float lon) {
+		this->lat = lat;
+		this->lon = lon;
+	}
 };
 
 class Relation;
+class Primitives;
 
 class Way : public Primitive {
 	private:
-	vector<const Node*> nodes;
+	mutable vector<const Node*> nodes;
+	vector<uint64_t> stored_node_ids;		//nodes in node store (see Primitives::useNodeStore()), they're created when they are needed
+	const Primitives *node_source;
+	mutable atomic<bool> stored_nodes_resolved;
 	vector<const Relation*> relations;
+	uint32_t version;		//0 when it isn't in input file
+
+	void resolveStoredNodes() const;
+	Rect getStoredNodesBounds() const;
+
+	friend class Primitives;
 
 	public:
-	Way(uint64_t id) : Primitive(id) { }
+	Way(uint64_t id) : Primitive(id), node_source(NULL), stored_nodes_resolved(false), version(0) { }
 	virtual ~Way() { }
+	uint32_t getVersion() const { return this->version; }
+	void setVersion(uint32_t version) { this->version = version; }
 	void addNodeToWay(const Node *node) {
 		this->nodes.push_back(node);
 	}
+	void addStoredNodeToWay(uint64_t node_id, const Primitives *primitives) {
+		this->stored_node_ids.push_back(node_id);
+		this->node_source = primitives;
+	}
 	void addWayToRelation(const Relation *relation) {
 		this->relations.push_back(relation);
 	}
+	void removeWayFromRelation(const Relation *relation) {
+		this->relations.erase(remove(this->relations.begin(), this->relations.end(), relation), this->relations.end());
+	}
+	void clearNodes() {
+		this->nodes.clear();
+	}
+	void removeNodes(const unordered_set<const Node*> &removed_nodes) {
+		vector<const Node*> rest;
+		for (vector<const Node*>::const_iterator it = this->nodes.begin(); it != this->nodes.end(); it++) {
+			if (removed_nodes.find(*it) == removed_nodes.end()) rest.push_back(*it);
+		}
+		this->nodes.swap(rest);
+	}
 	const vector<const Node*> &getNodes() const {
+		if (!this->stored_node_ids.empty() && !this->stored_nodes_resolved.load(memory_order_acquire)) this->resolveStoredNodes();
 		return this->nodes;
 	}
+	const vector<uint64_t> &getStoredNodeIds() const {
+		return this->stored_node_ids;
+	}
+	bool hasNodes() const {
+		return (!this->stored_node_ids.empty() || !this->nodes.empty());
+	}
 	const vector<const Relation*> &getRelations() const {
 		return this->relations;
 	}
-	uint64_t getFirstNodeId() const { return this->nodes.at(0)->getId(); }
-	uint64_t getLastNodeId() const { return this->nodes.at(this->nodes.size()-1)->getId(); }
+	uint64_t getFirstNodeId() const {
+		if (!this->stored_node_ids.empty()) return this->stored_node_ids.front();
+		return this->nodes.at(0)->getId();
+	}
+	uint64_t getLastNodeId() const {
+		if (!this->stored_node_ids.empty()) return this->stored_node_ids.back();
+		return this->nodes.at(this->nodes.size()-1)->getId();
+	}
+	Rect getBounds() const {
+		if (!this->stored_node_ids.empty()) return this->getStoredNodesBounds();		//without creating nodes
+		assert(!this->nodes.empty());
+		Rect bounds = { this->nodes[0]->getLat(), this->nodes[0]->getLon(), this->nodes[0]->getLat(), this->nodes[0]->getLon() };
+		for (vector<const Node*>::const_iterator it = this->nodes.begin()+1; it != this->nodes.end(); it++) {
+			if ((*it)->getLat() < bounds.minlat) bounds.minlat = (*it)->getLat();
+			if ((*it)->getLat() > bounds.maxlat) bounds.maxlat = (*it)->getLat();
+			if ((*it)->getLon() < bounds.minlon) bounds.minlon = (*it)->getLon();
+			if ((*it)->getLon() > bounds.maxlon) bounds.maxlon = (*it)->getLon();
+		}
+		return bounds;
+	}
+	bool isInRect(const Rect &rect) const {		//true when bounding box of way intersects rect
+		return (this->hasNodes() && this->getBounds().intersects(rect));
+	}
 };
 
 struct PrimitiveRole {
@@ -95,12 +172,15 @@ struct PrimitiveRole {
 class Relation : public Primitive {
 	private:
 	vector<const PrimitiveRole*> members;
+	uint32_t version;		//0 when it isn't in input file
 
 	public:
-	Relation(uint64_t id) : Primitive(id) { }
+	Relation(uint64_t id) : Primitive(id), version(0) { }
 	virtual ~Relation() {
 		for (vector<const PrimitiveRole*>::iterator it = this->members.begin(); it != this->members.end(); it++) delete *it;
 	}
+	uint32_t getVersion() const { return this->version; }
+	void setVersion(uint32_t version) { this->version = version; }
 	void addMemberToRelation(const Primitive &primitive, const char *role) {
 		PrimitiveRole *primitive_role = new PrimitiveRole(primitive, role);
 		this->members.push_back(primitive_role);
@@ -114,15 +194,52 @@ class Relation : public Primitive {
 	const vector<const PrimitiveRole*> &getRelationMembers() const {
 		return this->members;
 	}
+	void clearMembers() {
+		for (vector<const PrimitiveRole*>::iterator it = this->members.begin(); it != this->members.end(); it++) delete *it;
+		this->members.clear();
+	}
+	void removeMembers(const unordered_set<const Primitive*> &removed_primitives) {
+		vector<const PrimitiveRole*> rest;
+		for (vector<const PrimitiveRole*>::const_iterator it = this->members.begin(); it != this->members.end(); it++) {
+			if (removed_primitives.find(&(*it)->primitive) == removed_primitives.end()) rest.push_back(*it);
+			else delete *it;
+		}
+		this->members.swap(rest);
+	}
+};
+
+//Ways of one multipolygon found by query, before it's assembled (see PrimitivesView::getMultiPolygonSources())
+struct MultiPolygonSource {
+	const Relation *relation;		//NULL for closed way which isn't in any relation
+	vector<const Way*> outer_ways;
+	vector<const Way*> holes;
+	bool must_have_attribute;		//found by its way, so assembled multipolygon must have the attribute itself
+
+	MultiPolygonSource(const Relation *relation, bool must_have_attribute) : relation(relation), must_have_attribute(must_have_attribute) { }
+	void addToMultiPolygon(class MultiPolygon *multipolygon) const;
+};
+
+//estimated memory of one kind of loaded structures (see Primitives::getMemoryUsage())
+struct MemoryUsage {
+	const char *structure;
+	size_t count;		//count of items (objects, tags, pointers...)
+	uint64_t bytes;		//including estimated overhead of heap allocations
+	bool file_backed;		//memory is mapped from file, so it's only partly resident
 };
 
 class Primitives {
 	private:
 	bool bounds_set_by_x_y;
+	int zoom;		//zoom of tile set by setBoundsByXY()
 	bool bounds_set;
 	Rect view_rect;
 	Rect interest_rect;
-	unordered_map<uint64_t,Node*> nodes;
+	unordered_map<uint64_t,Node*> nodes;		//with node store only nodes with tags (see useNodeStore())
+	class NodeStore *node_store;
+	mutable unordered_map<uint64_t,Node*> stored_nodes;		//nodes created from node store for ways
+	mutable mutex stored_nodes_lock;
+	mutable size_t views_count;		//existing views, nodes created from node store are released when the last one ends
+	mutable condition_variable stored_nodes_released;
 	unordered_map<uint64_t,Way*> ways;
 	unordered_map<uint64_t,Relation*> relations;
 	unordered_map<string,const char*> ignored_attributes;
@@ -130,41 +247,68 @@ class Primitives {
 	unordered_map<string,size_t> disused_attributes;
 
 	//copied from OpenStreetMap wiki
-	double lon2tilex(double lon, int z) { return (((lon + 180.0) / 360.0 * pow(2.0, z))); }
-	double lat2tiley(double lat, int z) { return ((1.0 - log(tan(lat * M_PI / 180.0) + 1.0 / cos(lat * M_PI / 180.0)) / M_PI) / 2.0 * pow(2.0, z));	}
-	double tilex2lon(int x, int z)	{ return x / pow(2.0, z) * 360.0 - 180; }
-	double tiley2lat(int y, int z) { double n = M_PI - 2.0 * M_PI * y / pow(2.0, z); return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n))); }
+	static double lon2tilex(double lon, int z) { return (((lon + 180.0) / 360.0 * pow(2.0, z))); }
+	static double lat2tiley(double lat, int z) { return ((1.0 - log(tan(lat * M_PI / 180.0) + 1.0 / cos(lat * M_PI / 180.0)) / M_PI) / 2.0 * pow(2.0, z));	}
+	static double tilex2lon(int x, int z)	{ return x / pow(2.0, z) * 360.0 - 180; }
+	static double tiley2lat(int y, int z) { double n = M_PI - 2.0 * M_PI * y / pow(2.0, z); return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n))); }
 
-	double halftiley2lat(int y, int z) { return tiley2lat(2*y, z); }
+	static double halftiley2lat(int y, int z) { return tiley2lat(2*y, z); }
 
-	double lon2relativex(double lon, int z) {
+	static double lon2relativex(double lon, int z) {
 		double tile_coord = lon2tilex(lon, z);
 		return (ceil(tile_coord) - tile_coord);
 	}
-	double lat2relativey(double lat, int z) {
+	static double lat2relativey(double lat, int z) {
 		double tile_coord = lat2tiley(lat, z);
 		return (ceil(tile_coord) - tile_coord);
 	}
 
 	void setInterestRectByViewRect();
+	bool finishLoading();
+	bool hasDrawnAttribute(const Primitive &primitive) const;
+
+	const Node *getStoredNode(uint64_t id) const;
+	void addView() const;
+	void removeView() const;
+	void releaseStoredNodes() const;
+
+	friend class Way;
+	friend class PrimitivesView;
+	friend struct OsmChangeState;
 
 	public:
 	Primitives();
 	~Primitives();
-	void setBoundsByXY(int tile_x, int tile_y);
+	static Rect getTileRect(int tile_x, int tile_y, int zoom);
+	static void getTilesInRect(const Rect &rect, set<pair<int,int> > *tiles);
+	void setBoundsByXY(int tile_x, int tile_y, int zoom);
 	void setIgnoredAttribute(const char *key, const char *value);
 	bool isAttributeIgnored(const char *key, const char *value) const;
 	void setLightlyIgnoredAttribute(const char *key, const char *value);
 	bool isAttributeLightlyIgnored(const char *key, const char *value) const;
 	void setExistingAttribute(const char *key, const char *value);
+	bool useNodeStore(const char *filename);
+	bool usesNodeStore() const { return (this->node_store != NULL); }
 	bool loadFromXml(const char *filename);
+	static bool isSnapshotFile(const char *filename);
+	bool loadFromSnapshot(const char *filename);
+	bool saveSnapshot(const char *filename) const;
+	bool applyChangeFromXml(const char *filename, set<pair<int,int> > *affected_tiles);
+	void dropUnusedPrimitives(const Rect *keep_rect);
+	void getMemoryUsage(vector<MemoryUsage> *output) const;
 	bool areBoundsSetByXY() const { return (this->bounds_set_by_x_y); }
+	int getZoom() const { return this->zoom; }
 	bool areBoundsSetInFile() const { return (this->bounds_set); }
 	Rect getViewRect() const { return this->view_rect; }
+	Rect getInterestRect() const { return this->interest_rect; }
 	void setBounds(double minlat, double minlon, double maxlat, double maxlon);
 	void addNode(uint64_t id, Node *node) {
 		this->nodes[id] = node;
 	}
+	bool finishNode(Node *node);
+	bool isNodeStored(uint64_t id) const;
+	Node *getNodeFromStore(uint64_t id);
+	void waitForStoredNodesLimit(size_t max_count) const;
 	void addWay(uint64_t id, Way *way) {
 		this->ways[id] = way;
 	}
@@ -181,9 +325,50 @@ class Primitives {
 		if (it == this->ways.end()) return NULL;
 		else return it->second;
 	}
+	Relation *getRelation(uint64_t id) const {
+		unordered_map<uint64_t,Relation*>::const_iterator it = this->relations.find(id);
+		if (it == this->relations.end()) return NULL;
+		else return it->second;
+	}
+	void setAttributesUsed(const unordered_set<string> &used_attributes);
+	void getDisusedAttributes(multimap<size_t,string> *output) const;
+};
+
+//Read-only access to loaded primitives with own view and interest rectangle. Queries don't change Primitives, so more
+//views (e.g. one for every tile) can be used from more threads at once.
+class PrimitivesView {
+	private:
+	const Primitives &primitives;
+	bool only_in_interest_rect;		//queries return only objects in interest rectangle
+	Rect view_rect;
+	Rect interest_rect;
+	int zoom;
+	class TaskPool *task_pool;		//NULL when queries run only in calling thread
+	unordered_set<string> used_attributes;		//"key=value" of all queries, see Primitives::setAttributesUsed()
+	size_t scanned_count;		//primitives checked by all queries
+	size_t matched_count;		//objects returned by all queries
+
+	bool isRelationInInterestRect(const Relation &relation) const;
+	void setAttributeUsed(const char *key, const char *value);
+	void getMultiPolygonSources(vector<MultiPolygonSource> *output, const char *key, const char *value);
+
+	PrimitivesView(const PrimitivesView&);		//not copyable, view is registered in Primitives
+
+	public:
+	PrimitivesView(const Primitives &primitives);
+	~PrimitivesView();
+	void setBoundsByXY(int tile_x, int tile_y, int zoom);
+	void setOnlyObjectsInInterestRect(bool only_in_interest_rect) { this->only_in_interest_rect = only_in_interest_rect; }
+	void setTaskPool(TaskPool *task_pool) { this->task_pool = task_pool; }
+	Rect getViewRect() const { return this->view_rect; }
+	Rect getInterestRect() const { return this->interest_rect; }
+	int getZoom() const { return this->zoom; }
+	const unordered_set<string> &getUsedAttributes() const { return this->used_attributes; }
+	size_t getScannedCount() const { return this->scanned_count; }
+	size_t getMatchedCount() const { return this->matched_count; }
 	void getNodesWithAttribute(list<const Node*> *output, const char *key, const char *value);
 	void getWaysWithAttribute(list<const Way*> *output, const char *key, const char *value);
 	void getMultiPolygonsWithAttribute(list<class MultiPolygon*> *output, const char *key, const char *value);
-	void getDisusedAttributes(multimap<size_t,string> *output) const;
+	void getCachedAreasWithAttribute(vector<shared_ptr<class CachedArea> > *output, const char *key, const char *value, class FeatureCache *feature_cache);
 };
 
@@ -0,0 +1,371 @@
+#include <expat.h>
+
+#include "global.h"
+#include "primitives.h"
+
+//Applying of osmChange file to loaded primitives. Changed objects are modified in place (ways and relations keep
+//pointers to them), deleted objects are removed from ways and relations and freed at the end. Areas of all changed
+//geometry (before and after the change) are collected, so tiles which must be rendered again can be computed.
+struct OsmChangeState {
+	enum Action { action_none, action_create, action_modify, action_delete };
+	struct Member {
+		bool is_way;
+		uint64_t id;
+		string role;
+	};
+
+	Primitives &primitives;
+	Action action;
+	string element;					//"node", "way" or "relation"; empty when not in element
+	uint64_t id;
+	uint32_t version;
+	bool id_set, lat_set, lon_set;
+	float lat, lon;
+	vector<pair<string,string> > tags;
+	vector<uint64_t> way_nodes;
+	vector<Member> members;
+
+	unordered_map<uint64_t,vector<uint64_t> > ways_by_node;		//ids of ways with node (or which had the node)
+	unordered_set<uint64_t> changed_ways;			//ways with changed geometry, e.g. because of moved node
+	unordered_set<uint64_t> changed_relations;		//relations with changed members or tags
+	unordered_set<const Primitive*> deleted_primitives;
+	vector<Rect> changed_areas;
+	size_t changes_count;
+
+	OsmChangeState(Primitives &primitives)
+	 : primitives(primitives), action(action_none), changes_count(0) {
+		for (unordered_map<uint64_t,Way*>::const_iterator it = primitives.ways.begin(); it != primitives.ways.end(); it++) {
+			this->addWayToIndex(*it->second);
+		}
+	}
+
+	void addWayToIndex(const Way &way) {
+		const vector<const Node*> &nodes = way.getNodes();
+		for (vector<const Node*>::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
+			this->ways_by_node[(*it)->getId()].push_back(way.getId());
+		}
+	}
+
+	void addPoint(float lat, float lon) {
+		const Rect rect = { lat, lon, lat, lon };
+		this->changed_areas.push_back(rect);
+	}
+
+	void addWayArea(const Way &way) {
+		if (!way.getNodes().empty()) this->changed_areas.push_back(way.getBounds());
+	}
+
+	void addRelationArea(const Relation &relation) {
+		const vector<const PrimitiveRole*> &members = relation.getRelationMembers();
+		for (vector<const PrimitiveRole*>::const_iterator it = members.begin(); it != members.end(); it++) {
+			const Way *way = dynamic_cast<const Way*>(&(*it)->primitive);
+			if (way != NULL) this->addWayArea(*way);
+		}
+	}
+
+	//geometry of ways with the node is changed too
+	void addWaysOfNode(uint64_t node_id) {
+		unordered_map<uint64_t,vector<uint64_t> >::const_iterator it = this->ways_by_node.find(node_id);
+		if (it == this->ways_by_node.end()) return;
+		for (vector<uint64_t>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+			const Way *way = this->primitives.getWay(*it2);
+			if (way == NULL) continue;
+			this->addWayArea(*way);
+			this->changed_ways.insert(*it2);
+		}
+	}
+
+	void setAttributes(Primitive *primitive) {
+		primitive->clearAttributes();
+		for (vector<pair<string,string> >::const_iterator it = this->tags.begin(); it != this->tags.end(); it++) {
+			const char *key = it->first.c_str(), *value = it->second.c_str();
+			if (this->primitives.isAttributeIgnored(key, value)) continue;
+			if (!this->primitives.isAttributeLightlyIgnored(key, value)) this->primitives.setExistingAttribute(key, value);
+			primitive->setAttribute(key, value);
+		}
+	}
+
+	void applyNode() {
+		Node *node = this->primitives.getNode(this->id);
+		if (node != NULL) {
+			this->addPoint(node->getLat(), node->getLon());
+			this->addWaysOfNode(this->id);
+		}
+
+		if (this->action == action_delete) {
+			if (node == NULL) return;
+			this->primitives.nodes.erase(this->id);
+			this->deleted_primitives.insert(node);
+			return;
+		}
+		if (!this->lat_set || !this->lon_set) {
+			cerr << "Found <node> without mandatory fields!" << endl;
+			return;
+		}
+
+		if (node == NULL) {
+			node = new Node(this->id, this->lat, this->lon);
+			this->primitives.addNode(this->id, node);
+		}
+		else node->setPosition(this->lat, this->lon);
+		this->setAttributes(node);
+		this->addPoint(this->lat, this->lon);
+	}
+
+	void applyWay() {
+		Way *way = this->primitives.getWay(this->id);
+		if (way != NULL) {
+			this->addWayArea(*way);
+			this->changed_ways.insert(this->id);
+		}
+
+		if (this->action == action_delete) {
+			if (way == NULL) return;
+			//relations lose the member, so their whole area changes (before and after the change)
+			const vector<const Relation*> &relations = way->getRelations();
+			for (vector<const Relation*>::const_iterator it = relations.begin(); it != relations.end(); it++) {
+				this->addRelationArea(**it);
+				this->changed_relations.insert((*it)->getId());
+			}
+			this->primitives.ways.erase(this->id);
+			this->deleted_primitives.insert(way);
+			return;
+		}
+
+		if (way == NULL) {
+			way = new Way(this->id);
+			this->primitives.addWay(this->id, way);
+		}
+		else way->clearNodes();
+		for (vector<uint64_t>::const_iterator it = this->way_nodes.begin(); it != this->way_nodes.end(); it++) {
+			const Node *node = this->primitives.getNode(*it);
+			if (node != NULL) way->addNodeToWay(node);
+		}
+		this->addWayToIndex(*way);
+		way->setVersion(this->version);
+		this->setAttributes(way);
+		this->changed_ways.insert(this->id);
+	}
+
+	void applyRelation() {
+		Relation *relation = this->primitives.getRelation(this->id);
+		if (relation != NULL) {
+			this->addRelationArea(*relation);
+			this->changed_relations.insert(this->id);
+
+			const vector<const PrimitiveRole*> &members = relation->getRelationMembers();
+			for (vector<const PrimitiveRole*>::const_iterator it = members.begin(); it != members.end(); it++) {
+				Way *way = this->primitives.getWay((*it)->primitive.getId());
+				if (way != NULL && way == &(*it)->primitive) way->removeWayFromRelation(relation);
+			}
+		}
+
+		if (this->action == action_delete) {
+			if (relation == NULL) return;
+			this->primitives.relations.erase(this->id);
+			relation->clearMembers();
+			delete relation;
+			return;
+		}
+
+		if (relation == NULL) {
+			relation = new Relation(this->id);
+			this->primitives.addRelation(this->id, relation);
+		}
+		else relation->clearMembers();
+		for (vector<Member>::const_iterator it = this->members.begin(); it != this->members.end(); it++) {
+			Primitive *primitive;
+			if (it->is_way) {
+				Way *way = this->primitives.getWay(it->id);
+				if (way != NULL) way->addWayToRelation(relation);
+				primitive = way;
+			}
+			else primitive = this->primitives.getNode(it->id);
+			if (primitive != NULL) relation->addMemberToRelation(*primitive, it->role.c_str());
+		}
+		relation->setVersion(this->version);
+		this->setAttributes(relation);
+		this->changed_relations.insert(this->id);
+	}
+
+	void apply() {
+		if (!this->id_set) {
+			cerr << "Found <" << this->element << "> without mandatory fields!" << endl;
+			return;
+		}
+		if (this->action == action_none) {
+			cerr << "Found <" << this->element << "> outside of <create>, <modify> or <delete>!" << endl;
+			return;
+		}
+
+		if (this->element == "node") this->applyNode();
+		else if (this->element == "way") this->applyWay();
+		else this->applyRelation();
+		this->changes_count++;
+	}
+
+	//removes deleted objects from ways and relations and frees them
+	void removeDeletedPrimitives() {
+		if (this->deleted_primitives.empty()) return;
+
+		unordered_set<const Node*> deleted_nodes;
+		for (unordered_set<const Primitive*>::const_iterator it = this->deleted_primitives.begin(); it != this->deleted_primitives.end(); it++) {
+			const Node *node = dynamic_cast<const Node*>(*it);
+			if (node != NULL) deleted_nodes.insert(node);
+		}
+		if (!deleted_nodes.empty()) {
+			for (unordered_map<uint64_t,Way*>::iterator it = this->primitives.ways.begin(); it != this->primitives.ways.end(); it++) {
+				it->second->removeNodes(deleted_nodes);
+			}
+		}
+		for (unordered_map<uint64_t,Relation*>::iterator it = this->primitives.relations.begin(); it != this->primitives.relations.end(); it++) {
+			it->second->removeMembers(this->deleted_primitives);
+		}
+
+		for (unordered_set<const Primitive*>::const_iterator it = this->deleted_primitives.begin(); it != this->deleted_primitives.end(); it++) {
+			delete *it;
+		}
+		this->deleted_primitives.clear();
+	}
+
+	//adds areas of changed objects after the change; relations with changed member ways are changed too
+	void addAreasAfterChange() {
+		for (unordered_set<uint64_t>::const_iterator it = this->changed_ways.begin(); it != this->changed_ways.end(); it++) {
+			const Way *way = this->primitives.getWay(*it);
+			if (way == NULL) continue;
+			this->addWayArea(*way);
+			const vector<const Relation*> &relations = way->getRelations();
+			for (vector<const Relation*>::const_iterator it2 = relations.begin(); it2 != relations.end(); it2++) {
+				this->changed_relations.insert((*it2)->getId());
+			}
+		}
+		for (unordered_set<uint64_t>::const_iterator it = this->changed_relations.begin(); it != this->changed_relations.end(); it++) {
+			const Relation *relation = this->primitives.getRelation(*it);
+			if (relation != NULL) this->addRelationArea(*relation);
+		}
+	}
+};
+
+static void XmlChangeStartElement(void *user_data, const char *name, const char **attributes) {
+	OsmChangeState *state = static_cast<OsmChangeState*>(user_data);
+
+	if (strcmp(name, "create") == 0) state->action = OsmChangeState::action_create;
+	else if (strcmp(name, "modify") == 0) state->action = OsmChangeState::action_modify;
+	else if (strcmp(name, "delete") == 0) state->action = OsmChangeState::action_delete;
+	else if (strcmp(name, "node") == 0 || strcmp(name, "way") == 0 || strcmp(name, "relation") == 0) {
+		if (!state->element.empty()) cerr << "Element <" << name << "> is in other element!" << endl;
+		state->element = name;
+		state->id_set = state->lat_set = state->lon_set = false;
+		state->version = 0;
+		state->tags.clear();
+		state->way_nodes.clear();
+		state->members.clear();
+
+		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
+			if (strcmp(attributes[i], "id") == 0) {
+				state->id = atol(attributes[i+1]);
+				state->id_set = true;
+			}
+			else if (strcmp(attributes[i], "version") == 0) state->version = atol(attributes[i+1]);
+			else if (strcmp(attributes[i], "lat") == 0) {
+				state->lat = atof(attributes[i+1]);
+				state->lat_set = true;
+			}
+			else if (strcmp(attributes[i], "lon") == 0) {
+				state->lon = atof(attributes[i+1]);
+				state->lon_set = true;
+			}
+		}
+	}
+	else if (state->element.empty()) {
+		if (strcmp(name, "osmChange") != 0) cerr << "Unknown element <" << name << "> in osmChange file!" << endl;
+	}
+	else if (strcmp(name, "tag") == 0) {
+		const char *key = NULL, *value = NULL;
+		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
+			if (strcmp(attributes[i], "k") == 0) key = attributes[i+1];
+			else if (strcmp(attributes[i], "v") == 0) value = attributes[i+1];
+		}
+		if (key != NULL && value != NULL) state->tags.push_back(make_pair(key, value));
+		else cerr << "Found <tag> without mandatory fields!" << endl;
+	}
+	else if (strcmp(name, "nd") == 0) {
+		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
+			if (strcmp(attributes[i], "ref") == 0) state->way_nodes.push_back(atol(attributes[i+1]));
+		}
+	}
+	else if (strcmp(name, "member") == 0) {
+		OsmChangeState::Member member;
+		bool type_set = false, id_set = false;
+		for (size_t i = 0; attributes != NULL && attributes[i] != NULL; i += 2) {
+			if (strcmp(attributes[i], "type") == 0) {
+				if (strcmp(attributes[i+1], "relation") == 0) return;		//do nothing with it (as when loading)
+				member.is_way = (strcmp(attributes[i+1], "way") == 0);
+				type_set = true;
+			}
+			else if (strcmp(attributes[i], "ref") == 0) {
+				member.id = atol(attributes[i+1]);
+				id_set = true;
+			}
+			else if (strcmp(attributes[i], "role") == 0) member.role = attributes[i+1];
+		}
+		if (type_set && id_set) state->members.push_back(member);
+		else cerr << "Found <member> with no mandatory fields!" << endl;
+	}
+}
+
+static void XmlChangeEndElement(void *user_data, const char *name) {
+	OsmChangeState *state = static_cast<OsmChangeState*>(user_data);
+
+	if (strcmp(name, "create") == 0 || strcmp(name, "modify") == 0 || strcmp(name, "delete") == 0) {
+		state->action = OsmChangeState::action_none;
+	}
+	else if (strcmp(name, "node") == 0 || strcmp(name, "way") == 0 || strcmp(name, "relation") == 0) {
+		state->apply();
+		state->element.clear();
+	}
+}
+
+//Applies osmChange file (.osc) and returns tiles of zoom 12 (Y divided by 2) where anything has changed
+bool Primitives::applyChangeFromXml(const char *filename, set<pair<int,int> > *affected_tiles) {
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		cerr << "Cannot open file " << filename << "!" << endl;
+		return false;
+	}
+	OsmChangeState state(*this);
+
+	XML_Parser parser = XML_ParserCreate(NULL);
+	XML_SetUserData(parser, &state);
+	XML_SetElementHandler(parser, XmlChangeStartElement, XmlChangeEndElement);
+
+	bool success = true;
+
+	while (true) {
+		char buffer[1000];
+		size_t len = fread(buffer, 1, sizeof(buffer), fp);
+		bool is_final = (len != sizeof(buffer));
+		if (XML_Parse(parser, buffer, len, is_final) == 0) {
+			cerr << "Error parsing file " << filename << " at line " << XML_GetCurrentLineNumber(parser) << ": " << XML_ErrorString(XML_GetErrorCode(parser)) << endl;
+			success = false;
+			break;
+		}
+		if (is_final) break;
+	}
+
+	XML_ParserFree(parser);
+	fclose(fp);
+
+	state.removeDeletedPrimitives();
+	state.addAreasAfterChange();
+	for (vector<Rect>::const_iterator it = state.changed_areas.begin(); it != state.changed_areas.end(); it++) {
+		getTilesInRect(*it, affected_tiles);
+	}
+
+	if (!g_quiet_mode) {
+		cout << "Changes: " << state.changes_count << " Affected tiles: " << affected_tiles->size() << endl;
+		cout << "Nodes: " << this->nodes.size() << " Ways: " << this->ways.size() << " Relations: " << this->relations.size() << endl;
+	}
+
+	return success;
+}
@@ -0,0 +1,188 @@
+
+#include "global.h"
+#include "primitives.h"
+
+//Snapshot is binary dump of loaded primitives (only with not ignored attributes). It's much faster to load than OSM
+//file and it's updated by osmChange files (see Primitives::applyChangeFromXml()). Numbers are in native byte order,
+//so snapshot can't be moved to machine with other architecture.
+#define SNAPSHOT_MAGIC "OSM2POVS"
+#define SNAPSHOT_VERSION 1
+
+template<typename T> static void WriteValue(ofstream &fs, T value) {
+	fs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T> static bool ReadValue(ifstream &fs, T *value) {
+	return (bool)fs.read(reinterpret_cast<char*>(value), sizeof(*value));
+}
+
+static void WriteString(ofstream &fs, const string &str) {
+	WriteValue<uint32_t>(fs, str.size());
+	fs.write(str.data(), str.size());
+}
+
+static bool ReadString(ifstream &fs, string *str) {
+	uint32_t size;
+	if (!ReadValue(fs, &size)) return false;
+	str->resize(size);
+	return (size == 0 || fs.read(&(*str)[0], size));
+}
+
+static void WriteAttributes(ofstream &fs, const Primitive &primitive) {
+	const unordered_map<string,string> &attributes = primitive.getAttributes();
+	WriteValue<uint32_t>(fs, attributes.size());
+	for (unordered_map<string,string>::const_iterator it = attributes.begin(); it != attributes.end(); it++) {
+		WriteString(fs, it->first);
+		WriteString(fs, it->second);
+	}
+}
+
+static bool ReadAttributes(ifstream &fs, Primitive *primitive, Primitives *primitives) {
+	uint32_t count;
+	if (!ReadValue(fs, &count)) return false;
+	for (uint32_t i = 0; i < count; i++) {
+		string key, value;
+		if (!ReadString(fs, &key) || !ReadString(fs, &value)) return false;
+		if (!primitives->isAttributeLightlyIgnored(key.c_str(), value.c_str()))
+			primitives->setExistingAttribute(key.c_str(), value.c_str());
+		primitive->setAttribute(key.c_str(), value.c_str());
+	}
+	return true;
+}
+
+bool Primitives::isSnapshotFile(const char *filename) {
+	ifstream fs(filename, ios_base::binary);
+	char magic[sizeof(SNAPSHOT_MAGIC)-1];
+	return (fs.read(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0);
+}
+
+bool Primitives::saveSnapshot(const char *filename) const {
+	ofstream fs(filename, ios_base::binary);
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+
+	fs.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)-1);
+	WriteValue<uint32_t>(fs, SNAPSHOT_VERSION);
+	WriteValue<uint8_t>(fs, this->bounds_set);
+	WriteValue(fs, this->view_rect);
+
+	WriteValue<uint64_t>(fs, this->nodes.size());
+	for (unordered_map<uint64_t,Node*>::const_iterator it = this->nodes.begin(); it != this->nodes.end(); it++) {
+		WriteValue(fs, it->first);
+		WriteValue(fs, it->second->getLat());
+		WriteValue(fs, it->second->getLon());
+		WriteAttributes(fs, *it->second);
+	}
+
+	WriteValue<uint64_t>(fs, this->ways.size());
+	for (unordered_map<uint64_t,Way*>::const_iterator it = this->ways.begin(); it != this->ways.end(); it++) {
+		WriteValue(fs, it->first);
+		const vector<const Node*> &nodes = it->second->getNodes();
+		WriteValue<uint32_t>(fs, nodes.size());
+		for (vector<const Node*>::const_iterator it2 = nodes.begin(); it2 != nodes.end(); it2++) WriteValue(fs, (*it2)->getId());
+		WriteAttributes(fs, *it->second);
+	}
+
+	WriteValue<uint64_t>(fs, this->relations.size());
+	for (unordered_map<uint64_t,Relation*>::const_iterator it = this->relations.begin(); it != this->relations.end(); it++) {
+		WriteValue(fs, it->first);
+		const vector<const PrimitiveRole*> &members = it->second->getRelationMembers();
+		WriteValue<uint32_t>(fs, members.size());
+		for (vector<const PrimitiveRole*>::const_iterator it2 = members.begin(); it2 != members.end(); it2++) {
+			WriteValue<uint8_t>(fs, dynamic_cast<const Way*>(&(*it2)->primitive) != NULL);
+			WriteValue(fs, (*it2)->primitive.getId());
+			WriteString(fs, (*it2)->role);
+		}
+		WriteAttributes(fs, *it->second);
+	}
+
+	if (!fs) {
+		cerr << "Error while writing " << filename << "!" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Primitives::loadFromSnapshot(const char *filename) {
+	ifstream fs(filename, ios_base::binary);
+	if (!fs) {
+		cerr << "Cannot open file " << filename << "!" << endl;
+		return false;
+	}
+
+	char magic[sizeof(SNAPSHOT_MAGIC)-1];
+	uint32_t version;
+	if (!fs.read(magic, sizeof(magic)) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || !ReadValue(fs, &version) || version != SNAPSHOT_VERSION) {
+		cerr << "File " << filename << " isn't snapshot of this version of osm2pov!" << endl;
+		return false;
+	}
+
+	uint8_t bounds_set;
+	Rect view_rect;
+	if (!ReadValue(fs, &bounds_set) || !ReadValue(fs, &view_rect)) goto BAD_FILE;
+	if (bounds_set && !this->areBoundsSetByXY())
+		this->setBounds(view_rect.minlat, view_rect.minlon, view_rect.maxlat, view_rect.maxlon);
+
+	{
+		uint64_t count;
+		if (!ReadValue(fs, &count)) goto BAD_FILE;
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t id;
+			float lat, lon;
+			if (!ReadValue(fs, &id) || !ReadValue(fs, &lat) || !ReadValue(fs, &lon)) goto BAD_FILE;
+			Node *node = new Node(id, lat, lon);
+			this->addNode(id, node);
+			if (!ReadAttributes(fs, node, this)) goto BAD_FILE;
+		}
+
+		if (!ReadValue(fs, &count)) goto BAD_FILE;
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t id;
+			uint32_t nodes_count;
+			if (!ReadValue(fs, &id) || !ReadValue(fs, &nodes_count)) goto BAD_FILE;
+			Way *way = new Way(id);
+			this->addWay(id, way);
+			for (uint32_t j = 0; j < nodes_count; j++) {
+				uint64_t node_id;
+				if (!ReadValue(fs, &node_id)) goto BAD_FILE;
+				const Node *node = this->getNode(node_id);
+				if (node == NULL) goto BAD_FILE;
+				way->addNodeToWay(node);
+			}
+			if (!ReadAttributes(fs, way, this)) goto BAD_FILE;
+		}
+
+		if (!ReadValue(fs, &count)) goto BAD_FILE;
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t id;
+			uint32_t members_count;
+			if (!ReadValue(fs, &id) || !ReadValue(fs, &members_count)) goto BAD_FILE;
+			Relation *relation = new Relation(id);
+			this->addRelation(id, relation);
+			for (uint32_t j = 0; j < members_count; j++) {
+				uint8_t is_way;
+				uint64_t member_id;
+				string role;
+				if (!ReadValue(fs, &is_way) || !ReadValue(fs, &member_id) || !ReadString(fs, &role)) goto BAD_FILE;
+				Primitive *primitive;
+				if (is_way) {
+					Way *way = this->getWay(member_id);
+					if (way != NULL) way->addWayToRelation(relation);
+					primitive = way;
+				}
+				else primitive = this->getNode(member_id);
+				if (primitive == NULL) goto BAD_FILE;
+				relation->addMemberToRelation(*primitive, role.c_str());
+			}
+			if (!ReadAttributes(fs, relation, this)) goto BAD_FILE;
+		}
+	}
+
+	return this->finishLoading();
+
+	BAD_FILE:
+	cerr << "Snapshot " << filename << " is damaged!" << endl;
+	return false;
+}
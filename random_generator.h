@@ -0,0 +1,34 @@
+#pragma once
+
+//Small pseudorandom generator (xorshift64*) seeded by id of object. Unlike rand() it has no global state, so random
+//details of every object (tree positions, sprite variants) are the same in every run, every tile and every thread.
+class RandomGenerator {
+	private:
+	uint64_t state;
+
+	static uint64_t mix(uint64_t value) {		//finalizer of SplitMix64, neighbouring values give unrelated results
+		value += 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		return value ^ (value >> 31);
+	}
+
+	public:
+	RandomGenerator(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {
+		if (this->state == 0) this->state = 1;
+	}
+	//generator for cell of world grid, so details placed in grid (e.g. trees) don't depend on tile which computes them
+	RandomGenerator(uint64_t seed, int64_t cell_x, int64_t cell_y) : state(mix(mix(mix(seed) ^ cell_x) ^ cell_y)) {
+		if (this->state == 0) this->state = 1;
+	}
+	uint64_t next() {
+		this->state ^= this->state >> 12;
+		this->state ^= this->state << 25;
+		this->state ^= this->state >> 27;
+		return this->state * 2685821657736338717ULL;
+	}
+	//returns number from 0 to max-1
+	size_t nextBelow(size_t max) {
+		return (this->next() >> 11) % max;
+	}
+};
@@ -0,0 +1,99 @@
+
+#include "global.h"
+#include "render_cost.h"
+
+static const char *KIND_NAMES[pov_object_kinds_count] = { "triangle", "polygon", "mesh2", "box", "cylinder", "sprite" };
+
+RenderCostModel::RenderCostModel() {
+	this->object_weights[pov_triangle] = 1;
+	this->object_weights[pov_polygon] = 1.5;
+	this->object_weights[pov_mesh] = 2;
+	this->object_weights[pov_box] = 1.2;
+	this->object_weights[pov_cylinder] = 1.5;
+	this->object_weights[pov_sprite] = 4;
+	this->vertex_weight = 0.01;
+	this->triangle_weight = 0.1;
+	this->seconds_per_cost = 0;
+}
+
+const char *RenderCostModel::getKindName(PovObjectKind kind) {
+	return KIND_NAMES[kind];
+}
+
+//File has lines "NAME WEIGHT", where NAME is kind of object (triangle, polygon, mesh2, box, cylinder, sprite),
+//per_vertex, per_triangle (of any object) or seconds_per_cost. Missing weights keep default values, # starts comment.
+bool RenderCostModel::loadFromFile(const char *filename) {
+	ifstream fs(filename);
+	if (!fs) {
+		cerr << "Cannot open file " << filename << "!" << endl;
+		return false;
+	}
+	string line;
+	while (getline(fs, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		stringstream s(line);
+		string name;
+		double weight;
+		if (!(s >> name >> weight) || weight < 0) {
+			cerr << "Bad line \"" << line << "\" in cost model " << filename << "!" << endl;
+			return false;
+		}
+
+		if (name == "per_vertex") this->vertex_weight = weight;
+		else if (name == "per_triangle") this->triangle_weight = weight;
+		else if (name == "seconds_per_cost") this->seconds_per_cost = weight;
+		else {
+			size_t kind = 0;
+			while (kind < pov_object_kinds_count && name != KIND_NAMES[kind]) kind++;
+			if (kind == pov_object_kinds_count) {
+				cerr << "Unknown weight " << name << " in cost model " << filename << "!" << endl;
+				return false;
+			}
+			this->object_weights[kind] = weight;
+		}
+	}
+	return true;
+}
+
+void RenderCostReport::addObjects(PovObjectKind kind, const char *style, size_t objects, size_t vertices, size_t triangles) {
+	ObjectCounts &counts = this->counts[make_pair(kind, string(style))];		//new counts are zeroed
+	counts.objects += objects;
+	counts.vertices += vertices;
+	counts.triangles += triangles;
+}
+
+double RenderCostReport::getCost(const RenderCostModel &model) const {
+	double cost = 0;
+	for (map<pair<PovObjectKind,string>,ObjectCounts>::const_iterator it = this->counts.begin(); it != this->counts.end(); it++) {
+		cost += it->second.objects * model.object_weights[it->first.first] + it->second.vertices * model.vertex_weight
+		 + it->second.triangles * model.triangle_weight;
+	}
+	return cost;
+}
+
+//Format is "cost C", "seconds S" (only when model is calibrated), "vertices V", "triangles T" and then line
+//"KIND STYLE OBJECTS VERTICES TRIANGLES" for every kind of object and style used in scene.
+bool RenderCostReport::write(const char *output_filename, const RenderCostModel &model) const {
+	const string filename = string(output_filename) + ".cost";
+	ofstream fs(filename.c_str());
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+
+	size_t vertices = 0, triangles = 0;
+	for (map<pair<PovObjectKind,string>,ObjectCounts>::const_iterator it = this->counts.begin(); it != this->counts.end(); it++) {
+		vertices += it->second.vertices;
+		triangles += it->second.triangles;
+	}
+	const double cost = this->getCost(model);
+	fs << "cost " << cost << "\n";
+	if (model.seconds_per_cost > 0) fs << "seconds " << cost * model.seconds_per_cost << "\n";
+	fs << "vertices " << vertices << "\n";
+	fs << "triangles " << triangles << "\n";
+	for (map<pair<PovObjectKind,string>,ObjectCounts>::const_iterator it = this->counts.begin(); it != this->counts.end(); it++) {
+		fs << KIND_NAMES[it->first.first] << " " << it->first.second << " " << it->second.objects << " " << it->second.vertices
+		 << " " << it->second.triangles << "\n";
+	}
+	return fs.good();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+//kinds of objects written by PovWriter
+enum PovObjectKind { pov_triangle, pov_polygon, pov_mesh, pov_box, pov_cylinder, pov_sprite, pov_object_kinds_count };
+
+//Relative cost of rendering of objects by POV-Ray. Default weights are rough estimates (sprites with transparent
+//textures are the most expensive, triangles in one mesh are cheaper than separate triangles); weights calibrated by
+//measured render times can be loaded from file (see README).
+struct RenderCostModel {
+	double object_weights[pov_object_kinds_count];		//for every object
+	double vertex_weight;
+	double triangle_weight;
+	double seconds_per_cost;		//0 when model isn't calibrated to time
+
+	RenderCostModel();
+	bool loadFromFile(const char *filename);
+	static const char *getKindName(PovObjectKind kind);
+};
+
+//Counts of objects of one scene by kind and texture. They are written next to output file (OUTPUT.cost) with
+//estimated cost of rendering, so tiles can be scheduled for rendering by their cost (the heaviest first).
+class RenderCostReport {
+	private:
+	struct ObjectCounts {
+		size_t objects;
+		size_t vertices;
+		size_t triangles;
+	};
+
+	map<pair<PovObjectKind,string>,ObjectCounts> counts;		//by kind and style
+
+	public:
+	void addObjects(PovObjectKind kind, const char *style, size_t objects, size_t vertices, size_t triangles);
+	double getCost(const RenderCostModel &model) const;
+	bool write(const char *output_filename, const RenderCostModel &model) const;
+};
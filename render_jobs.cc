@@ -0,0 +1,158 @@
+#include "global.h"
+#include "render_jobs.h"
+
+#include <errno.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+bool TileJournal::open(const char *filename) {
+	lock_guard<mutex> guard(this->lock);
+	bool incomplete_line = false;
+	streamoff complete_size = 0;		//size of complete lines
+	{
+		ifstream fs(filename);		//it doesn't exist in first run
+		string line;
+		while (getline(fs, line)) {
+			if (fs.eof()) {		//line without end, written when run was interrupted
+				incomplete_line = true;
+				break;
+			}
+			complete_size = fs.tellg();
+			stringstream s(line);
+			int x, y;
+			if (s >> x >> y) this->done_tiles.insert(make_pair(x, y));
+		}
+	}
+	if (incomplete_line && truncate(filename, complete_size) != 0) {
+		cerr << "Cannot truncate " << filename << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	this->fs.open(filename, ios_base::out | ios_base::app);
+	if (!this->fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool TileJournal::isDone(int x, int y) {
+	lock_guard<mutex> guard(this->lock);
+	return (this->done_tiles.find(make_pair(x, y)) != this->done_tiles.end());
+}
+
+bool TileJournal::markDone(int x, int y) {
+	lock_guard<mutex> guard(this->lock);
+	this->done_tiles.insert(make_pair(x, y));
+	stringstream line;
+	line << x << " " << y << "\n";
+	this->fs << line.str() << flush;
+	return this->fs.good();
+}
+
+RenderJobRunner::RenderJobRunner(const char *command, size_t processes_count, size_t max_attempts, TileJournal *journal)
+ : command(command), processes_count(max<size_t>(processes_count, 1)), max_attempts(max<size_t>(max_attempts, 1)), journal(journal) {
+}
+
+//it can be called from more threads after tile is written
+void RenderJobRunner::addJob(int x, int y, const string &filename, double cost) {
+	Job job = { x, y, filename, cost, 0 };
+
+	lock_guard<mutex> guard(this->lock);
+	this->jobs.push_back(job);
+}
+
+bool RenderJobRunner::IsCostHigher(const Job &a, const Job &b) {
+	if (a.cost != b.cost) return (a.cost > b.cost);
+	return (make_pair(a.y, a.x) < make_pair(b.y, b.x));
+}
+
+//value is in single quotes for shell, quote inside it ends them, is escaped and they continue
+static string QuoteForShell(const string &value) {
+	string quoted = "'";
+	for (string::const_iterator it = value.begin(); it != value.end(); it++) {
+		if (*it == '\'') quoted += "'\\''";
+		else quoted += *it;
+	}
+	return quoted + "'";
+}
+
+string RenderJobRunner::getCommand(const Job &job) const {
+	stringstream command;
+	for (const char *c = this->command.c_str(); *c != '\0'; c++) {
+		if (c[0] == '%' && c[1] == 'x') { command << "'" << job.x << "'"; c++; }
+		else if (c[0] == '%' && c[1] == 'y') { command << "'" << job.y << "'"; c++; }
+		else if (c[0] == '%' && c[1] == 'f') { command << QuoteForShell(job.filename); c++; }
+		else command << *c;
+	}
+	return command.str();
+}
+
+//returns pid of started process or -1
+pid_t RenderJobRunner::startJob(const Job &job) const {
+	const string command = this->getCommand(job);
+	const pid_t pid = fork();
+	if (pid == 0) {
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char*)NULL);
+		_exit(127);
+	}
+	if (pid < 0) cerr << "Cannot run \"" << command << "\": " << strerror(errno) << endl;
+	return pid;
+}
+
+//runs all added jobs; returns false when some tile wasn't rendered even after all attempts
+bool RenderJobRunner::run() {
+	sort(this->jobs.begin(), this->jobs.end(), IsCostHigher);
+	map<pid_t,Job> running;
+	bool success = true;
+	bool starting = true;		//when command can't be started, only running ones are waited for (and journaled)
+
+	while ((starting && !this->jobs.empty()) || !running.empty()) {
+		while (starting && running.size() < this->processes_count && !this->jobs.empty()) {
+			Job job = this->jobs.front();
+			this->jobs.pop_front();
+			job.attempts++;
+			if (!g_quiet_mode) {
+				cout << "Rendering tile " << job.x << " " << job.y << " (cost " << job.cost;
+				if (job.attempts > 1) cout << ", attempt " << job.attempts;
+				cout << ")" << endl;
+			}
+			const pid_t pid = this->startJob(job);
+			if (pid < 0) {
+				starting = false;
+				success = false;
+				break;
+			}
+			running[pid] = job;
+		}
+
+		if (running.empty()) break;
+		int status;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			cerr << "Waiting for render command failed: " << strerror(errno) << endl;
+			return false;
+		}
+		map<pid_t,Job>::iterator it = running.find(pid);
+		if (it == running.end()) continue;		//not our process
+		const Job job = it->second;
+		running.erase(it);
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			if (this->journal != NULL && !this->journal->markDone(job.x, job.y)) {
+				cerr << "Cannot write journal!" << endl;
+				success = false;
+			}
+		}
+		else if (starting && job.attempts < this->max_attempts) {
+			cerr << "Rendering of tile " << job.x << " " << job.y << " failed, it will be tried again." << endl;
+			this->jobs.push_front(job);		//it's still one of the heaviest
+		}
+		else {
+			cerr << "Rendering of tile " << job.x << " " << job.y << " failed after " << job.attempts << " attempts." << endl;
+			success = false;
+		}
+	}
+	return success;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <sys/types.h>
+
+//Progress of batch run: tiles which are done are appended to file as lines "X Y" (the same format as --tile-list),
+//so interrupted run can be started again and it skips them. Line is written at once and flushed, so at most the
+//last line can be incomplete; it's removed when the journal is opened and the tile is done again.
+class TileJournal {
+	private:
+	set<pair<int,int> > done_tiles;
+	ofstream fs;
+	mutex lock;		//guards everything
+
+	public:
+	bool open(const char *filename);
+	bool isDone(int x, int y);
+	bool markDone(int x, int y);
+};
+
+//Runs render command for every written tile in bounded pool of processes, the heaviest tiles (by estimated cost of
+//tile) first, so the longest renders don't stay at the end. Command is run by /bin/sh, %x and %y in it are replaced
+//by coords of tile and %f by file of tile, all quoted for shell. Failed command is run again, at most max_attempts times together.
+class RenderJobRunner {
+	private:
+	struct Job {
+		int x, y;
+		string filename;
+		double cost;		//estimated by RenderCostModel
+		size_t attempts;
+	};
+
+	string command;
+	size_t processes_count;
+	size_t max_attempts;
+	TileJournal *journal;		//NULL when progress isn't saved
+	deque<Job> jobs;		//waiting jobs
+	mutex lock;		//guards jobs
+
+	static bool IsCostHigher(const Job &a, const Job &b);
+	string getCommand(const Job &job) const;
+	pid_t startJob(const Job &job) const;
+
+	public:
+	RenderJobRunner(const char *command, size_t processes_count, size_t max_attempts, TileJournal *journal);
+	void addJob(int x, int y, const string &filename, double cost);
+	bool run();
+};
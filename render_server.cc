@@ -0,0 +1,186 @@
+
+#include "global.h"
+#include "render_server.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#define MAX_REQUEST_LENGTH 4096
+#define CONNECTION_TIMEOUT_SECONDS 10		//idle connection (or client which doesn't read answer) is closed after it
+
+//sends all data; MSG_NOSIGNAL, so disconnected client doesn't kill the daemon by SIGPIPE
+static bool SendAll(int fd, const char *data, size_t size) {
+	while (size > 0) {
+		const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return false;
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static bool SendAll(int fd, const string &data) {
+	return SendAll(fd, data.c_str(), data.size());
+}
+
+//reads one line (without '\n') from socket; buffer holds data read after the line
+static bool ReceiveLine(int fd, string *buffer, string *line) {
+	while (true) {
+		const size_t end_pos = buffer->find('\n');
+		if (end_pos != string::npos) {
+			*line = buffer->substr(0, end_pos);
+			buffer->erase(0, end_pos+1);
+			if (!line->empty() && (*line)[line->size()-1] == '\r') line->erase(line->size()-1);
+			return true;
+		}
+		if (buffer->size() > MAX_REQUEST_LENGTH) return false;
+
+		char data[1024];
+		const ssize_t received = recv(fd, data, sizeof(data), 0);
+		if (received < 0 && errno == EINTR) continue;
+		if (received <= 0) return false;
+		buffer->append(data, received);
+	}
+}
+
+//workers_count 0 means one worker for every CPU core
+RenderServer::RenderServer(const RenderFunction &render, size_t workers_count)
+ : render(render), workers_count(workers_count), socket_fd(-1) {
+	if (this->workers_count == 0) this->workers_count = thread::hardware_concurrency();
+	if (this->workers_count == 0) this->workers_count = 1;
+}
+
+RenderServer::~RenderServer() {
+	if (this->socket_fd >= 0) {
+		close(this->socket_fd);
+		unlink(this->socket_path.c_str());
+	}
+}
+
+bool RenderServer::listen(const char *socket_path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		cerr << "Socket path " << socket_path << " is too long!" << endl;
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	this->socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (this->socket_fd < 0) {
+		cerr << "Cannot create socket: " << strerror(errno) << endl;
+		return false;
+	}
+	unlink(socket_path);		//socket left by previous run
+	if (bind(this->socket_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+	 || ::listen(this->socket_fd, SOMAXCONN) != 0) {
+		cerr << "Cannot listen on socket " << socket_path << ": " << strerror(errno) << endl;
+		close(this->socket_fd);
+		this->socket_fd = -1;
+		return false;
+	}
+	this->socket_path = socket_path;
+	return true;
+}
+
+//serves requests until the process is killed; calling thread is one of workers
+void RenderServer::run() {
+	assert(this->socket_fd >= 0);
+	vector<thread> workers;
+	for (size_t i = 1; i < this->workers_count; i++) workers.push_back(thread(&RenderServer::runWorker, this));
+	this->runWorker();
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++) it->join();
+}
+
+void RenderServer::runWorker() {
+	while (true) {
+		const int connection_fd = accept(this->socket_fd, NULL, NULL);
+		if (connection_fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			cerr << "Cannot accept connection: " << strerror(errno) << endl;
+			return;
+		}
+		//every connection holds worker, so idle client mustn't block it forever
+		const timeval timeout = { CONNECTION_TIMEOUT_SECONDS, 0 };
+		setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(connection_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		this->handleConnection(connection_fd);
+		close(connection_fd);
+	}
+}
+
+void RenderServer::handleConnection(int connection_fd) {
+	string buffer, request;
+	while (ReceiveLine(connection_fd, &buffer, &request)) {
+		if (request.empty()) continue;
+		if (!this->handleRequest(connection_fd, request)) return;
+	}
+}
+
+//returns false when connection is broken
+bool RenderServer::handleRequest(int connection_fd, const string &request) {
+	istringstream s(request);
+	string command;
+	int x, y;
+	if (!(s >> command >> x >> y) || command != "tile") return SendAll(connection_fd, "ERROR Bad request, expected \"tile X Y [ZOOM] [PATH]\"\n");
+
+	int zoom = DEFAULT_ZOOM;
+	string path;
+	if (s >> path) {
+		char *end;
+		const long number = strtol(path.c_str(), &end, 10);
+		if (*end == '\0') {			//the first optional parameter is zoom
+			zoom = number;
+			path.clear();
+			s >> path;
+		}
+	}
+
+	if (!path.empty()) {
+		string error;
+		if (!this->render(x, y, zoom, path.c_str(), &error)) return SendAll(connection_fd, "ERROR " + error + "\n");
+		return SendAll(connection_fd, "OK " + path + "\n");
+	}
+
+	//scene is written to temporary file and then sent
+	char filename[] = "/tmp/osm2pov-XXXXXX.pov";
+	const int fd = mkstemps(filename, 4);
+	if (fd < 0) return SendAll(connection_fd, string("ERROR Cannot create temporary file: ") + strerror(errno) + "\n");
+	close(fd);
+
+	string error;
+	bool connection_ok;
+	if (this->render(x, y, zoom, filename, &error)) connection_ok = this->sendTileFile(connection_fd, filename);
+	else connection_ok = SendAll(connection_fd, "ERROR " + error + "\n");
+	unlink(filename);
+	unlink((string(filename) + ".hash").c_str());
+	unlink((string(filename) + ".cost").c_str());		//with --cost-report
+	unlink((string(filename) + ".index.csv").c_str());		//with --index
+	return connection_ok;
+}
+
+bool RenderServer::sendTileFile(int connection_fd, const char *filename) {
+	ifstream fs(filename, ios_base::binary);
+	fs.seekg(0, ios_base::end);
+	const streamoff size = fs.tellg();
+	fs.seekg(0, ios_base::beg);
+	if (!fs || size < 0) return SendAll(connection_fd, "ERROR Cannot read written tile\n");
+
+	stringstream header;
+	header << "OK " << size << "\n";
+	if (!SendAll(connection_fd, header.str())) return false;
+
+	char data[65536];
+	streamoff remaining = size;
+	while (remaining > 0 && fs.read(data, min<streamoff>(remaining, sizeof(data)))) {
+		if (!SendAll(connection_fd, data, fs.gcount())) return false;
+		remaining -= fs.gcount();
+	}
+	return (remaining == 0);
+}
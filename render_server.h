@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+
+//Daemon serving tiles from data loaded once. It listens on Unix domain socket and reads requests as lines:
+//  tile X Y [ZOOM] [PATH]
+//When PATH is set, tile is written to this file and answer is "OK PATH". Otherwise tile is written as POV scene
+//and sent back as "OK SIZE" followed by SIZE bytes of the scene. On failure answer is "ERROR message".
+//More requests can be sent by one connection. Connections are handled by fixed number of workers, so at most
+//workers_count tiles are generated at once; other connections wait in queue of the socket. Connection which doesn't
+//send next request (or doesn't read answer) in 10 s is closed, so idle clients can't hold workers.
+class RenderServer {
+	public:
+	//writes tile to file; returns false (and sets error) when tile can't be written
+	typedef function<bool(int x, int y, int zoom, const char *filename, string *error)> RenderFunction;
+
+	private:
+	RenderFunction render;
+	size_t workers_count;
+	int socket_fd;
+	string socket_path;
+
+	void runWorker();
+	void handleConnection(int connection_fd);
+	bool handleRequest(int connection_fd, const string &request);
+	bool sendTileFile(int connection_fd, const char *filename);
+
+	public:
+	RenderServer(const RenderFunction &render, size_t workers_count);
+	~RenderServer();
+	bool listen(const char *socket_path);
+	void run();
+};
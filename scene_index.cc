@@ -0,0 +1,37 @@
+
+#include "global.h"
+#include "scene_index.h"
+
+//objects written since first_object (until next feature) belong to the feature
+void SceneIndex::beginFeature(size_t first_object, const vector<uint64_t> &ids, const string &rule) {
+	Feature feature;
+	feature.first_object = first_object;
+	feature.ids = ids;
+	feature.rule = rule;
+	this->features.push_back(feature);
+}
+
+//features without any written object are left out
+bool SceneIndex::write(const char *output_filename, size_t objects_count) const {
+	const string filename = string(output_filename) + ".index.csv";
+	ofstream fs(filename.c_str());
+	if (!fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+
+	fs << "first_object,objects,osm_ids,rule\n";
+	for (size_t i = 0; i < this->features.size(); i++) {
+		const Feature &feature = this->features[i];
+		const size_t end_object = (i+1 < this->features.size() ? this->features[i+1].first_object : objects_count);
+		if (end_object == feature.first_object) continue;
+
+		fs << feature.first_object << "," << end_object - feature.first_object << ",";
+		for (vector<uint64_t>::const_iterator it = feature.ids.begin(); it != feature.ids.end(); it++) {
+			if (it != feature.ids.begin()) fs << " ";
+			fs << *it;
+		}
+		fs << "," << feature.rule << "\n";		//rules are made only of tags and styles without commas
+	}
+	return fs.good();
+}
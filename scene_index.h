@@ -0,0 +1,20 @@
+#pragma once
+
+//Index of written objects (--index): OSM features and draw rules which made them, so output can be debugged without
+//comments in it. It's written next to output file as CSV (OUTPUT.index.csv) with lines
+//"first_object,objects,osm_ids,rule". Objects are numbered from 0 in order of writing as they are counted by --stats
+//(triangles, polygons, boxes, cylinders and sprites; mesh counts its triangles), more ids are separated by spaces.
+class SceneIndex {
+	private:
+	struct Feature {
+		size_t first_object;
+		vector<uint64_t> ids;
+		string rule;
+	};
+
+	vector<Feature> features;		//in order of writing
+
+	public:
+	void beginFeature(size_t first_object, const vector<uint64_t> &ids, const string &rule);
+	bool write(const char *output_filename, size_t objects_count) const;
+};
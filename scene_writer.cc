@@ -0,0 +1,35 @@
+
+#include "global.h"
+#include "output_polygon.h"
+#include "scene_writer.h"
+#include "primitives.h"
+
+
+double metres2unit(double metres) {
+	return metres / 60;
+}
+
+SceneWriter::SceneWriter(const Rect &view_rect, bool fix_size_to_square, int zoom) {
+	this->view_rect = view_rect;
+	this->zoom = zoom;
+	this->zoom_scale = pow(2.0, zoom-DEFAULT_ZOOM);
+	memset(&this->counters, 0, sizeof(this->counters));
+	this->comments = false;
+
+	if (fix_size_to_square) {			//fix coords to make area square
+		const double weighted_lat_diff = (this->view_rect.maxlat - this->view_rect.minlat)/LAT_WEIGHT;
+		const double weighted_lon_diff = (this->view_rect.maxlon - this->view_rect.minlon)/LON_WEIGHT;
+		if (weighted_lat_diff > weighted_lon_diff) {
+			const double lon_center = (this->view_rect.minlon + this->view_rect.maxlon)/2;
+			const double new_diff_to_center = (lon_center-this->view_rect.minlon)*(weighted_lat_diff/weighted_lon_diff);
+			this->view_rect.minlon = lon_center - new_diff_to_center;
+			this->view_rect.maxlon = lon_center + new_diff_to_center;
+		}
+		else {
+			const double lat_center = (this->view_rect.minlat + this->view_rect.maxlat)/2;
+			const double new_diff_to_center = (lat_center-this->view_rect.minlat)*(weighted_lon_diff/weighted_lat_diff);
+			this->view_rect.minlat = lat_center - new_diff_to_center;
+			this->view_rect.maxlat = lat_center + new_diff_to_center;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#define LAT_WEIGHT 0.1138
+#define LON_WEIGHT 0.0878
+
+#include "primitives.h"
+
+double metres2unit(double metres);		//in default zoom
+
+//counts of objects written by SceneWriter (see --stats)
+struct SceneCounters {
+	size_t triangles;
+	size_t polygons;
+	size_t boxes;
+	size_t cylinders;
+	size_t sprites;
+	uint64_t bytes;		//output written or buffered so far
+};
+
+//Abstract output of 3D scene. Implementations write it in some concrete format (POV-Ray, Wavefront OBJ, glTF)
+//All coords except sprite position are in output units (see convertLatToCoord() and convertLonToCoord()).
+//Output of tile has the same size in units in every zoom, so sizes in units are multiplied by zoom_scale.
+class SceneWriter {
+	protected:
+	Rect view_rect;			 //visible rectangle
+	int zoom;
+	double zoom_scale;		//2^(zoom-DEFAULT_ZOOM)
+	SceneCounters counters;		//bytes are computed by getCounters()
+	bool comments;		//comments are written (--comments); they only help to read output
+
+	public:
+	SceneWriter(const Rect &view_rect, bool fix_size_to_square, int zoom);
+	virtual ~SceneWriter() { }
+	virtual bool isOpened() const = 0;
+	virtual bool close() = 0;		//writes rest of output; returns false when it couldn't be written
+	void setComments(bool comments) { this->comments = comments; }
+	bool writesComments() const { return this->comments; }
+	virtual void writeComment(const char *comment) = 0;
+	virtual void writePolygon(uint64_t id, const vector<Triangle> &triangles, double height, const char *style) = 0;
+	virtual void writePolygon(const Polygon3D &polygon, const char *style) = 0;
+	virtual void writeMesh(const Mesh &mesh) = 0;
+	virtual void writeBox(double x, double y, double width, double height, double length, double angle, const char *style) = 0;
+	virtual void writeCylinder(double x, double y, double radius, double height, const char *style) = 0;
+	virtual void writeSprite(double x, double y, const char *sprite_style, size_t sprite_style_number, double scale) = 0;
+
+	virtual SceneCounters getCounters() const {
+		return this->counters;
+	}
+	size_t getObjectsCount() const {		//objects written so far (see SceneIndex)
+		return this->counters.triangles + this->counters.polygons + this->counters.boxes + this->counters.cylinders + this->counters.sprites;
+	}
+	int getZoom() const {
+		return this->zoom;
+	}
+	double convertLatToCoord(double lat) const {
+		return (lat - (this->view_rect.minlat+this->view_rect.maxlat)/2) / LAT_WEIGHT * 100 * 2 * this->zoom_scale;
+	}
+	double convertLonToCoord(double lon) const {
+		return (lon - (this->view_rect.minlon+this->view_rect.maxlon)/2) / LON_WEIGHT * 100 * this->zoom_scale + 100;
+	}
+	double convertMetresToCoord(double metres) const {
+		return metres2unit(metres) * this->zoom_scale;
+	}
+};
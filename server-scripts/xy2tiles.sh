@@ -5,14 +5,21 @@ X=$2
 Y=$3
 
 DIR=/tmp
+HASH_DIR=./hashes		#hashes of rendered tiles, kept between runs
 
 ./xy2osm.php "$INPUT" "$DIR/tile-$X-$Y.osm" $X $Y
 
 osm2pov "$DIR/tile-$X-$Y.osm" "$DIR/tile-$X-$Y.pov" $X $Y
 
-povray +W8192 +H8192 +B100 +FN -D +A "+I$DIR/tile-$X-$Y.pov" "+O$DIR/tile-$X-$Y.png"
+mkdir -p "$HASH_DIR"
+if cmp -s "$DIR/tile-$X-$Y.pov.hash" "$HASH_DIR/tile-$X-$Y.pov.hash"; then
+	echo "Tile $X $Y hasn't changed, skipping rendering"
+else
+	povray +W8192 +H8192 +B100 +FN -D +A "+I$DIR/tile-$X-$Y.pov" "+O$DIR/tile-$X-$Y.png"
 
-./png2tiles.sh "$DIR/tile-$X-$Y.png" $X $Y
+	./png2tiles.sh "$DIR/tile-$X-$Y.png" $X $Y && cp "$DIR/tile-$X-$Y.pov.hash" "$HASH_DIR/"
+fi
 
 rm "$DIR/tile-$X-$Y.osm"
 rm "$DIR/tile-$X-$Y.pov"
+rm "$DIR/tile-$X-$Y.pov.hash"
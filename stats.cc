@@ -0,0 +1,164 @@
+
+#include <iomanip>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "output_polygon.h"
+#include "stats.h"
+#include "primitives.h"
+#include "trace.h"
+
+//resident memory of process now, read from /proc (so it's known only on Linux)
+static uint64_t GetRss() {
+	ifstream fs("/proc/self/statm");
+	uint64_t size, resident;
+	if (!(fs >> size >> resident)) return 0;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static uint64_t GetPeakRss() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;		//in kilobytes on Linux
+}
+
+void Stats::addPhase(const char *name, double seconds) {
+	const uint64_t rss = GetRss();
+	const PhaseStats phase = { name, seconds, rss, max(rss, GetPeakRss()) };		//kernel updates peak lazily
+	this->phases.push_back(phase);
+	if (g_trace != NULL) {
+		const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+		g_trace->addSpan("phase", name, end - chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds)), end, 0);
+	}
+}
+
+void Stats::addMemory(const char *phase, const vector<MemoryUsage> &structures) {
+	this->memory.push_back(make_pair(string(phase), structures));
+}
+
+RuleStats &Stats::getRule(const string &name) {
+	map<string,RuleStats>::iterator it = this->rules.find(name);
+	if (it == this->rules.end()) {
+		RuleStats rule;
+		memset(&rule, 0, sizeof(rule));
+		it = this->rules.insert(make_pair(name, rule)).first;
+	}
+	return it->second;
+}
+
+static void AddRuleStats(RuleStats *rule, size_t calls, double seconds, size_t scanned, size_t matched, const SceneCounters &written) {
+	rule->calls += calls;
+	rule->seconds += seconds;
+	rule->scanned += scanned;
+	rule->matched += matched;
+	rule->written.triangles += written.triangles;
+	rule->written.polygons += written.polygons;
+	rule->written.boxes += written.boxes;
+	rule->written.cylinders += written.cylinders;
+	rule->written.sprites += written.sprites;
+	rule->written.bytes += written.bytes;
+}
+
+void Stats::addRule(const string &name, double seconds, size_t scanned, size_t matched, const SceneCounters &written) {
+	AddRuleStats(&this->getRule(name), 1, seconds, scanned, matched, written);
+}
+
+void Stats::merge(const Stats &other) {
+	this->phases.insert(this->phases.end(), other.phases.begin(), other.phases.end());
+	this->memory.insert(this->memory.end(), other.memory.begin(), other.memory.end());
+	for (map<string,RuleStats>::const_iterator it = other.rules.begin(); it != other.rules.end(); it++) {
+		const RuleStats &rule = it->second;
+		AddRuleStats(&this->getRule(it->first), rule.calls, rule.seconds, rule.scanned, rule.matched, rule.written);
+	}
+}
+
+static bool IsRuleSlower(const pair<const string,RuleStats> *a, const pair<const string,RuleStats> *b) {
+	if (a->second.seconds != b->second.seconds) return (a->second.seconds > b->second.seconds);
+	return (a->first < b->first);
+}
+
+//the slowest rules first
+void Stats::getRulesByTime(vector<const pair<const string,RuleStats>*> *output) const {
+	for (map<string,RuleStats>::const_iterator it = this->rules.begin(); it != this->rules.end(); it++) output->push_back(&*it);
+	sort(output->begin(), output->end(), IsRuleSlower);
+}
+
+void Stats::printTable(ostream &os) const {
+	os << left << setw(24) << "Phase" << right << setw(10) << "Time [s]" << setw(10) << "RSS [MB]" << setw(15) << "Peak RSS [MB]" << endl;
+	for (vector<PhaseStats>::const_iterator it = this->phases.begin(); it != this->phases.end(); it++) {
+		os << left << setw(24) << it->name << right << setw(10) << fixed << setprecision(3) << it->seconds
+		 << setw(10) << setprecision(1) << it->rss/1e6 << setw(15) << it->peak_rss/1e6 << endl;
+	}
+	os << endl;
+
+	for (vector<pair<string,vector<MemoryUsage> > >::const_iterator it = this->memory.begin(); it != this->memory.end(); it++) {
+		os << left << setw(32) << "Memory after " + it->first << right << setw(12) << "Count" << setw(14) << "Bytes" << setw(12) << "Bytes/item" << endl;
+		uint64_t total_bytes = 0;
+		for (vector<MemoryUsage>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+			os << left << setw(32) << string(it2->structure) + (it2->file_backed ? " (file)" : "") << right << setw(12) << it2->count
+			 << setw(14) << it2->bytes << setw(12) << setprecision(1) << (it2->count > 0 ? static_cast<double>(it2->bytes)/it2->count : 0) << endl;
+			if (!it2->file_backed) total_bytes += it2->bytes;
+		}
+		os << left << setw(32) << "total in memory" << right << setw(26) << total_bytes << endl << endl;
+	}
+
+	vector<const pair<const string,RuleStats>*> rules;
+	this->getRulesByTime(&rules);
+	os << left << setw(48) << "Rule" << right << setw(7) << "Calls" << setw(10) << "Time [s]" << setw(10) << "Scanned"
+	 << setw(9) << "Matched" << setw(11) << "Triangles" << setw(9) << "Polygons" << setw(7) << "Boxes"
+	 << setw(10) << "Cylinders" << setw(9) << "Sprites" << setw(12) << "Bytes" << endl;
+	for (vector<const pair<const string,RuleStats>*>::const_iterator it = rules.begin(); it != rules.end(); it++) {
+		const RuleStats &rule = (*it)->second;
+		os << left << setw(48) << (*it)->first << right << setw(7) << rule.calls << setw(10) << fixed << setprecision(3) << rule.seconds
+		 << setw(10) << rule.scanned << setw(9) << rule.matched << setw(11) << rule.written.triangles
+		 << setw(9) << rule.written.polygons << setw(7) << rule.written.boxes << setw(10) << rule.written.cylinders
+		 << setw(9) << rule.written.sprites << setw(12) << rule.written.bytes << endl;
+	}
+	os.unsetf(ios_base::floatfield);
+}
+
+//names of phases and rules contain only tags, styles and file names, so only quotes and backslashes are escaped
+string GetJsonString(const string &str) {
+	string output = "\"";
+	for (string::const_iterator it = str.begin(); it != str.end(); it++) {
+		if (*it == '"' || *it == '\\') output += '\\';
+		output += *it;
+	}
+	return output + "\"";
+}
+
+void Stats::printJson(ostream &os) const {
+	os << "{\"phases\":[";
+	for (vector<PhaseStats>::const_iterator it = this->phases.begin(); it != this->phases.end(); it++) {
+		if (it != this->phases.begin()) os << ",";
+		os << "{\"name\":" << GetJsonString(it->name) << ",\"seconds\":" << it->seconds << ",\"rss\":" << it->rss
+		 << ",\"peak_rss\":" << it->peak_rss << "}";
+	}
+	os << "],\"memory\":[";
+
+	for (vector<pair<string,vector<MemoryUsage> > >::const_iterator it = this->memory.begin(); it != this->memory.end(); it++) {
+		if (it != this->memory.begin()) os << ",";
+		os << "{\"phase\":" << GetJsonString(it->first) << ",\"structures\":[";
+		for (vector<MemoryUsage>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+			if (it2 != it->second.begin()) os << ",";
+			os << "{\"name\":" << GetJsonString(it2->structure) << ",\"count\":" << it2->count << ",\"bytes\":" << it2->bytes
+			 << ",\"file_backed\":" << (it2->file_backed ? "true" : "false") << "}";
+		}
+		os << "]}";
+	}
+	os << "],\"rules\":[";
+
+	vector<const pair<const string,RuleStats>*> rules;
+	this->getRulesByTime(&rules);
+	for (vector<const pair<const string,RuleStats>*>::const_iterator it = rules.begin(); it != rules.end(); it++) {
+		const RuleStats &rule = (*it)->second;
+		if (it != rules.begin()) os << ",";
+		os << "{\"name\":" << GetJsonString((*it)->first) << ",\"calls\":" << rule.calls << ",\"seconds\":" << rule.seconds
+		 << ",\"scanned\":" << rule.scanned << ",\"matched\":" << rule.matched << ",\"triangles\":" << rule.written.triangles
+		 << ",\"polygons\":" << rule.written.polygons << ",\"boxes\":" << rule.written.boxes
+		 << ",\"cylinders\":" << rule.written.cylinders << ",\"sprites\":" << rule.written.sprites
+		 << ",\"bytes\":" << rule.written.bytes << "}";
+	}
+	os << "]}" << endl;
+}
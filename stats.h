@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+
+#include "scene_writer.h"
+
+//Measures wall time since it's created
+class StopWatch {
+	private:
+	chrono::steady_clock::time_point start;
+
+	public:
+	StopWatch() : start(chrono::steady_clock::now()) { }
+	double getSeconds() const {
+		return chrono::duration<double>(chrono::steady_clock::now() - this->start).count();
+	}
+	chrono::steady_clock::time_point getStart() const { return this->start; }
+};
+
+struct PhaseStats {
+	string name;
+	double seconds;
+	uint64_t rss;		//resident memory of process at end of phase (0 when unknown)
+	uint64_t peak_rss;		//the highest resident memory of process until end of phase
+};
+
+struct RuleStats {
+	size_t calls;
+	double seconds;
+	size_t scanned;			//primitives checked by queries of rule
+	size_t matched;			//features returned by queries of rule
+	SceneCounters written;
+};
+
+//Statistics printed with --stats: wall time and memory of phases of run, estimated memory of loaded structures and
+//counters of every draw rule of Osm2PovConverter.
+//Every tile collects its own statistics and they are merged when it's written, so rules are summed over all tiles.
+class Stats {
+	private:
+	vector<PhaseStats> phases;		//in order of run
+	vector<pair<string,vector<MemoryUsage> > > memory;		//name of phase after which memory was estimated and structures
+	map<string,RuleStats> rules;		//by name of rule (kind of drawing, key=value and style)
+
+	RuleStats &getRule(const string &name);
+	void getRulesByTime(vector<const pair<const string,RuleStats>*> *output) const;
+
+	public:
+	void addPhase(const char *name, double seconds);
+	void addMemory(const char *phase, const vector<MemoryUsage> &structures);
+	void addRule(const string &name, double seconds, size_t scanned, size_t matched, const SceneCounters &written);
+	void merge(const Stats &other);
+	void printTable(ostream &os) const;
+	void printJson(ostream &os) const;
+};
+
+string GetJsonString(const string &str);		//quoted string for JSON output (also of Trace)
@@ -0,0 +1,159 @@
+
+#include "global.h"
+#include "task_pool.h"
+
+static thread_local const TaskPool *g_current_pool = NULL;		//pool of current worker thread
+static thread_local size_t g_current_worker_pos = 0;
+
+//Thread calling wait() is one of workers (with queue 0), so the pool starts only threads_count-1 threads.
+//threads_count 0 means one thread for every CPU core.
+TaskPool::TaskPool(size_t threads_count) : queued_count(0), pending_count(0), next_queue(0), stopping(false) {
+	if (threads_count == 0) threads_count = thread::hardware_concurrency();
+	if (threads_count == 0) threads_count = 1;
+
+	for (size_t i = 0; i < threads_count; i++) this->queues.push_back(new WorkerQueue());
+	for (size_t i = 1; i < threads_count; i++) this->threads.push_back(thread(&TaskPool::runWorker, this, i));
+}
+
+TaskPool::~TaskPool() {
+	this->wait();
+	{
+		lock_guard<mutex> guard(this->lock);
+		this->stopping = true;
+	}
+	this->changed.notify_all();
+	for (vector<thread>::iterator it = this->threads.begin(); it != this->threads.end(); it++) it->join();
+	for (vector<WorkerQueue*>::iterator it = this->queues.begin(); it != this->queues.end(); it++) delete *it;
+}
+
+void TaskPool::submit(const function<void()> &task) {
+	{
+		lock_guard<mutex> guard(this->lock);
+		size_t queue_pos;
+		if (g_current_pool == this) queue_pos = g_current_worker_pos;
+		else {
+			queue_pos = this->next_queue;
+			this->next_queue = (this->next_queue+1) % this->queues.size();
+		}
+		WorkerQueue *queue = this->queues[queue_pos];
+		{
+			lock_guard<mutex> queue_guard(queue->lock);
+			queue->tasks.push_back(task);
+		}
+		this->queued_count++;
+		this->pending_count++;
+	}
+	this->changed.notify_all();
+}
+
+//takes task from the back of own queue, or steals it from the front of queue of other worker
+bool TaskPool::takeTask(size_t queue_pos, function<void()> *task) {
+	for (size_t i = 0; i < this->queues.size(); i++) {
+		WorkerQueue *queue = this->queues[(queue_pos+i) % this->queues.size()];
+		lock_guard<mutex> queue_guard(queue->lock);
+		if (queue->tasks.empty()) continue;
+		if (i == 0) {
+			*task = queue->tasks.back();
+			queue->tasks.pop_back();
+		}
+		else {
+			*task = queue->tasks.front();
+			queue->tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void TaskPool::runTask(const function<void()> &task) {
+	{
+		lock_guard<mutex> guard(this->lock);
+		this->queued_count--;
+	}
+	task();
+	{
+		lock_guard<mutex> guard(this->lock);
+		this->pending_count--;
+	}
+	this->changed.notify_all();
+}
+
+void TaskPool::runWorker(size_t worker_pos) {
+	g_current_pool = this;
+	g_current_worker_pos = worker_pos;
+
+	while (true) {
+		function<void()> task;
+		if (this->takeTask(worker_pos, &task)) {
+			this->runTask(task);
+			continue;
+		}
+
+		unique_lock<mutex> guard(this->lock);
+		while (!this->stopping && this->queued_count == 0) this->changed.wait(guard);
+		if (this->stopping) return;
+	}
+}
+
+//Waits until all submitted tasks (including tasks submitted by them) are finished. The calling thread meanwhile
+//runs tasks too. It can't be called from a task of this pool.
+void TaskPool::wait() {
+	assert(g_current_pool != this);
+	while (true) {
+		function<void()> task;
+		if (this->takeTask(0, &task)) {
+			this->runTask(task);
+			continue;
+		}
+
+		unique_lock<mutex> guard(this->lock);
+		while (this->pending_count > 0 && this->queued_count == 0) this->changed.wait(guard);
+		if (this->pending_count == 0) return;
+	}
+}
+
+void TaskGroup::submit(const function<void()> &task) {
+	{
+		lock_guard<mutex> guard(this->pool.lock);
+		this->pending_count++;
+	}
+	this->pool.submit([this, task]() {
+		task();
+		lock_guard<mutex> guard(this->pool.lock);
+		this->pending_count--;			//waiting threads are notified by runTask()
+	});
+}
+
+void TaskGroup::wait() {
+	const size_t queue_pos = (g_current_pool == &this->pool ? g_current_worker_pos : 0);
+	while (true) {
+		function<void()> task;
+		if (this->pool.takeTask(queue_pos, &task)) {
+			this->pool.runTask(task);
+			continue;
+		}
+
+		unique_lock<mutex> guard(this->pool.lock);
+		while (this->pending_count > 0 && this->pool.queued_count == 0) this->pool.changed.wait(guard);
+		if (this->pending_count == 0) return;
+	}
+}
+
+//Runs body(i) for every i from 0 to count-1 and waits until all of them finish. Indices are split to a few tasks
+//per thread, so small bodies don't pay for submitting a task each. When pool is NULL, it runs in calling thread.
+void ParallelFor(TaskPool *pool, size_t count, const function<void(size_t)> &body) {
+	if (pool == NULL || pool->getThreadsCount() == 1 || count < 2) {
+		for (size_t i = 0; i < count; i++) body(i);
+		return;
+	}
+
+	const size_t tasks_count = min(count, pool->getThreadsCount()*4);
+	TaskGroup group(*pool);
+	for (size_t i = 0; i < tasks_count; i++) {
+		const size_t begin = count*i/tasks_count, end = count*(i+1)/tasks_count;
+		group.submit([&body, begin, end]() {
+			for (size_t j = begin; j < end; j++) body(j);
+		});
+	}
+	group.wait();
+}
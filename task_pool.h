@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Pool of worker threads with work stealing. Every worker has its own queue; tasks submitted by a worker go to its
+//queue and the worker takes them from the back (the newest first), idle workers steal from front of queues of others.
+//So one big task (e.g. tile with large forest) doesn't leave other workers waiting.
+class TaskPool {
+	private:
+	struct WorkerQueue {
+		mutex lock;
+		deque<function<void()> > tasks;
+	};
+
+	vector<WorkerQueue*> queues;
+	vector<thread> threads;
+	mutex lock;						//guards counters below
+	condition_variable changed;		//task was submitted or finished, or pool is stopping
+	size_t queued_count;			//tasks in queues
+	size_t pending_count;			//tasks submitted and not finished yet
+	size_t next_queue;				//queue for tasks submitted from other threads than workers
+	bool stopping;
+
+	friend class TaskGroup;
+
+	bool takeTask(size_t queue_pos, function<void()> *task);
+	void runTask(const function<void()> &task);
+	void runWorker(size_t worker_pos);
+
+	public:
+	TaskPool(size_t threads_count);
+	~TaskPool();
+	size_t getThreadsCount() const { return this->queues.size(); }
+	void submit(const function<void()> &task);
+	void wait();
+};
+
+//Part of tasks of a pool which can be waited for separately, also from a task of the pool (e.g. features of one tile
+//when tiles are written by the pool). Waiting thread runs tasks of the pool meanwhile.
+class TaskGroup {
+	private:
+	TaskPool &pool;
+	size_t pending_count;		//guarded by pool.lock
+
+	public:
+	TaskGroup(TaskPool &pool) : pool(pool), pending_count(0) { }
+	~TaskGroup() { this->wait(); }
+	void submit(const function<void()> &task);
+	void wait();
+};
+
+void ParallelFor(TaskPool *pool, size_t count, const function<void(size_t)> &body);
@@ -0,0 +1,57 @@
+
+#include <iomanip>
+
+#include "global.h"
+#include "output_polygon.h"
+#include "trace.h"
+#include "primitives.h"
+#include "stats.h"
+
+Trace *g_trace = NULL;
+
+Trace::Trace() : has_event(false) {
+}
+
+Trace::~Trace() {
+	if (this->fs.is_open()) this->close();
+}
+
+bool Trace::open(const char *filename) {
+	this->fs.open(filename);
+	if (!this->fs) {
+		cerr << "Cannot open " << filename << "!" << endl;
+		return false;
+	}
+	this->start = chrono::steady_clock::now();
+	this->fs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	return true;
+}
+
+bool Trace::close() {
+	lock_guard<mutex> guard(this->lock);
+	this->fs << "\n]}\n";
+	this->fs.close();
+	return !this->fs.fail();
+}
+
+size_t Trace::getThreadId() {
+	map<thread::id,size_t>::const_iterator it = this->thread_ids.find(this_thread::get_id());
+	if (it != this->thread_ids.end()) return it->second;
+	const size_t id = this->thread_ids.size() + 1;
+	this->thread_ids[this_thread::get_id()] = id;
+	return id;
+}
+
+//complete event ("ph":"X") with times in microseconds since trace was opened
+void Trace::addSpan(const char *category, const string &name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end, uint64_t id) {
+	const double start_us = chrono::duration<double,micro>(start - this->start).count();
+	const double duration_us = chrono::duration<double,micro>(end - start).count();
+
+	lock_guard<mutex> guard(this->lock);
+	this->fs << (this->has_event ? ",\n" : "\n");
+	this->has_event = true;
+	this->fs << "{\"name\":" << GetJsonString(name) << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"ts\":" << fixed << setprecision(1) << start_us
+	 << ",\"dur\":" << duration_us << ",\"pid\":1,\"tid\":" << this->getThreadId();
+	if (id != 0) this->fs << ",\"args\":{\"id\":" << id << "}";
+	this->fs << "}";
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#define TRACE_MIN_FEATURE_SECONDS 0.001		//shorter spans of single features aren't written
+
+//Spans of work written to file as Chrome trace events (--trace), they can be opened in chrome://tracing or in
+//Perfetto. Events are written as they end, so the file is complete only when trace is closed.
+class Trace {
+	private:
+	ofstream fs;
+	mutex lock;		//guards everything below
+	chrono::steady_clock::time_point start;
+	bool has_event;
+	map<thread::id,size_t> thread_ids;		//small numbers in order of first event of thread
+
+	size_t getThreadId();
+
+	public:
+	Trace();
+	~Trace();
+	bool open(const char *filename);
+	bool close();
+	void addSpan(const char *category, const string &name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end, uint64_t id);
+};
+
+extern Trace *g_trace;		//NULL when tracing is off
+
+//Span from its creation to its end. Spans of features are written only when they take at least min_seconds, so
+//trace shows long-tail features (e.g. huge forest) without thousands of tiny spans.
+class TraceSpan {
+	private:
+	const char *category;
+	const char *name;
+	uint64_t id;		//0 means no id
+	double min_seconds;
+	chrono::steady_clock::time_point start;
+
+	public:
+	TraceSpan(const char *category, const char *name, uint64_t id = 0, double min_seconds = 0)
+	 : category(category), name(name), id(id), min_seconds(min_seconds) {
+		if (g_trace != NULL) this->start = chrono::steady_clock::now();
+	}
+	~TraceSpan() {
+		if (g_trace == NULL) return;
+		const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+		if (chrono::duration<double>(end - this->start).count() >= this->min_seconds) g_trace->addSpan(this->category, this->name, this->start, end, this->id);
+	}
+};